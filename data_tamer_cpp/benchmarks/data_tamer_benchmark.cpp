@@ -1,8 +1,19 @@
 #include <benchmark/benchmark.h>
 #include "data_tamer/data_sink.hpp"
 #include "data_tamer/data_tamer.hpp"
+#include "data_tamer/sinks/dummy_sink.hpp"
+#include "data_tamer/sinks/mcap_sink.hpp"
+#include "data_tamer_parser/data_tamer_parser.hpp"
 #include "../examples/geometry_types.hpp"
 
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <thread>
+
 using namespace DataTamer;
 
 class NullSink : public DataSinkBase
@@ -29,6 +40,25 @@ static void DT_Doubles(benchmark::State& state)
   }
 }
 
+static void DT_ScalarDoubles(benchmark::State& state)
+{
+  std::vector<double> values(size_t(state.range(0)));
+
+  auto registry = ChannelsRegistry();
+  auto channel = registry.getChannel("channel");
+  channel->addDataSink(std::make_shared<NullSink>());
+
+  for(size_t i = 0; i < values.size(); i++)
+  {
+    channel->registerValue("value_" + std::to_string(i), &values[i]);
+  }
+
+  for(auto _ : state)
+  {
+    channel->takeSnapshot();
+  }
+}
+
 static void DT_PoseType(benchmark::State& state)
 {
   std::vector<TestTypes::Pose> poses(size_t(state.range(0)));
@@ -45,7 +75,341 @@ static void DT_PoseType(benchmark::State& state)
   }
 }
 
+// Arguments: number of writer threads, seqlock mode (0 = mutex, 1 = seqlock).
+// The counters show how many times the writers could update their values
+// and the longest time they had to wait.
+static void DT_MultiWriter(benchmark::State& state)
+{
+  const auto writers_count = size_t(state.range(0));
+  auto registry = ChannelsRegistry();
+  auto channel = registry.getChannel("channel");
+  channel->addDataSink(std::make_shared<NullSink>());
+  channel->setSeqLockMode(state.range(1) != 0);
+
+  std::vector<std::array<double, 100>> values(writers_count);
+  std::vector<std::shared_ptr<LoggedValue<double>>> logged_values;
+  for(size_t w = 0; w < writers_count; w++)
+  {
+    channel->registerValue("values_" + std::to_string(w), &values[w]);
+    logged_values.push_back(
+        channel->createLoggedValue<double>("logged_" + std::to_string(w)));
+  }
+
+  std::atomic_bool stop = false;
+  std::atomic_int64_t writes = 0;
+  std::atomic_int64_t max_wait_ns = 0;
+  std::vector<std::thread> writers;
+  for(size_t w = 0; w < writers_count; w++)
+  {
+    writers.emplace_back([&, w]() {
+      auto logged = logged_values[w];
+      int64_t count = 0;
+      int64_t max_wait = 0;
+      while(!stop)
+      {
+        const auto t1 = std::chrono::steady_clock::now();
+        if(auto ptr = logged->getMutablePtr())
+        {
+          *ptr += 1.0;
+        }
+        if(auto* seqlock = channel->seqLock())
+        {
+          const SeqLockWriteGuard guard(*seqlock);
+          values[w].fill(double(count));
+        }
+        else
+        {
+          std::scoped_lock lk(channel->writeMutex());
+          values[w].fill(double(count));
+        }
+        const auto t2 = std::chrono::steady_clock::now();
+        max_wait = std::max<int64_t>(max_wait, (t2 - t1).count());
+        count++;
+      }
+      writes += count;
+      int64_t prev = max_wait_ns;
+      while(prev < max_wait && !max_wait_ns.compare_exchange_weak(prev, max_wait))
+      {
+      }
+    });
+  }
+
+  for(auto _ : state)
+  {
+    channel->takeSnapshot();
+  }
+  stop = true;
+  for(auto& writer : writers)
+  {
+    writer.join();
+  }
+  state.counters["writes"] = benchmark::Counter(double(writes), benchmark::Counter::kIsRate);
+  state.counters["max_write_us"] = double(max_wait_ns) / 1000.0;
+  state.counters["torn"] = double(channel->tornSnapshotsCount());
+}
+
+// Arguments: number of values, type (0 = LoggedValue, 1 = AtomicLoggedValue)
+static void DT_LoggedValueSet(benchmark::State& state)
+{
+  const auto count = size_t(state.range(0));
+  auto registry = ChannelsRegistry();
+  auto channel = registry.getChannel("channel");
+
+  std::vector<std::shared_ptr<LoggedValue<double>>> values;
+  std::vector<std::shared_ptr<AtomicLoggedValue<double>>> atomic_values;
+  for(size_t i = 0; i < count; i++)
+  {
+    const auto name = "value_" + std::to_string(i);
+    if(state.range(1) == 0)
+    {
+      values.push_back(channel->createLoggedValue<double>(name));
+    }
+    else
+    {
+      atomic_values.push_back(channel->createAtomicLoggedValue<double>(name));
+    }
+  }
+
+  double x = 0;
+  for(auto _ : state)
+  {
+    for(auto& value : values)
+    {
+      value->set(x);
+    }
+    for(auto& value : atomic_values)
+    {
+      value->set(x);
+    }
+    x += 1.0;
+  }
+}
+
+// Arguments: clock (0 = SystemClock, 1 = SteadyClock, 2 = TSCClock)
+static void DT_Clock(benchmark::State& state)
+{
+  ClockBase::Ptr clock;
+  switch(state.range(0))
+  {
+    case 0:
+      clock = std::make_shared<SystemClock>();
+      break;
+    case 1:
+      clock = std::make_shared<SteadyClock>();
+      break;
+    default:
+      clock = std::make_shared<TSCClock>();
+  }
+  for(auto _ : state)
+  {
+    benchmark::DoNotOptimize(clock->now());
+  }
+}
+
+// Argument: index of the options in the vector below.
+// Reports the throughput and the compression ratio of each configuration.
+// The compression may run in other threads: the time is the real one, and
+// process_cpu_us is the CPU time of all the threads (stopRecording included)
+// per snapshot.
+static void DT_MCAPWrite(benchmark::State& state)
+{
+  using Compression = MCAPSinkOptions::Compression;
+  using Level = MCAPSinkOptions::CompressionLevel;
+  static const std::vector<std::pair<const char*, MCAPSinkOptions>> options_sets = [] {
+    std::vector<std::pair<const char*, MCAPSinkOptions>> sets;
+    MCAPSinkOptions opt;
+    sets.emplace_back("none", opt);
+    opt.no_chunk_crc = true;
+    opt.no_message_index = true;
+    sets.emplace_back("none_no_crc_no_index", opt);
+    opt = {};
+    opt.compression = Compression::LZ4;
+    opt.compression_level = Level::FASTEST;
+    sets.emplace_back("lz4_fastest", opt);
+    opt.compression_level = Level::DEFAULT;
+    sets.emplace_back("lz4_default", opt);
+    opt.compression = Compression::ZSTD;
+    opt.compression_level = Level::FASTEST;
+    sets.emplace_back("zstd_fastest", opt);
+    opt.compression_level = Level::DEFAULT;
+    sets.emplace_back("zstd_default", opt);
+    opt.chunk_size = 4 * 1024 * 1024;
+    sets.emplace_back("zstd_default_4MB_chunks", opt);
+    opt.chunk_size = MCAPSinkOptions{}.chunk_size;
+    opt.compression_threads = 2;
+    sets.emplace_back("zstd_default_2_threads", opt);
+    opt.compression_threads = 4;
+    sets.emplace_back("zstd_default_4_threads", opt);
+    return sets;
+  }();
+
+  const auto& [label, options] = options_sets.at(size_t(state.range(0)));
+  state.SetLabel(label);
+  if(!MCAPSink::isCompressionAvailable(options.compression))
+  {
+    state.SkipWithError("compression not available");
+    return;
+  }
+  const auto filepath =
+      (std::filesystem::temp_directory_path() / "dt_benchmark.mcap").string();
+  size_t bytes = 0;
+  {
+    MCAPSink sink(filepath, options);
+    // realistic data: slowly changing doubles
+    std::vector<double> values(500);
+    auto channel = LogChannel::create("channel");
+    channel->registerValue("values", &values);
+    Schema schema = channel->getSchema();
+    sink.addChannel("channel", schema);
+
+    Snapshot snapshot;
+    snapshot.channel_name = "channel";
+    snapshot.schema_hash = schema.hash;
+    snapshot.active_mask = { 0xFF };
+    snapshot.payload.resize(sizeof(uint32_t) + values.size() * sizeof(double));
+    int64_t count = 0;
+    const std::clock_t cpu_start = std::clock();
+    for(auto _ : state)
+    {
+      for(size_t i = 0; i < values.size(); i++)
+      {
+        values[i] = std::sin(double(count + int64_t(i)) * 0.001);
+      }
+      const auto size = uint32_t(values.size());
+      std::memcpy(snapshot.payload.data(), &size, sizeof(uint32_t));
+      std::memcpy(snapshot.payload.data() + sizeof(uint32_t), values.data(),
+                  values.size() * sizeof(double));
+      snapshot.timestamp = std::chrono::nanoseconds(count++);
+      sink.storeSnapshot(snapshot);
+      bytes += snapshot.payload.size();
+    }
+    sink.stopRecording();
+    const double cpu_us = 1e6 * double(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+    state.counters["process_cpu_us"] =
+        benchmark::Counter(cpu_us, benchmark::Counter::kAvgIterations);
+  }
+  state.SetBytesProcessed(int64_t(bytes));
+  state.counters["compression_ratio"] =
+      double(bytes) / double(std::filesystem::file_size(filepath));
+  std::filesystem::remove(filepath);
+}
+
+// Argument: 0 = ParseSnapshot, 1 = ParsePlan, 2 = ParsePlan with a projection of 4 series
+static void DT_Parse(benchmark::State& state)
+{
+  std::vector<TestTypes::Pose> poses(100);
+  std::array<double, 300> values = {};
+
+  auto channel = LogChannel::create("channel");
+  auto sink = std::make_shared<DummySink>();
+  channel->addDataSink(sink);
+  channel->registerValue("poses", &poses);
+  channel->registerValue("values", &values);
+  channel->takeSnapshot();
+  while(sink->getStatistics().stored == 0)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  const auto schema = DataTamerParser::BuilSchemaFromText(ToStr(channel->getSchema()));
+  const Snapshot& snapshot = sink->latest_snapshot;
+  const DataTamerParser::SnapshotView view = {
+    snapshot.schema_hash,
+    uint64_t(snapshot.timestamp.count()),
+    { snapshot.active_mask.data(), snapshot.active_mask.size() },
+    { snapshot.payload.data(), snapshot.payload.size() }
+  };
+  DataTamerParser::ParsePlan plan(schema);
+  if(state.range(0) == 2)
+  {
+    plan.setProjection(std::vector<std::string>{ "values[10]", "values[250]",
+                                                 "poses[50]/position/x",
+                                                 "poses[99]/rotation/w" });
+  }
+
+  double sum = 0;
+  for(auto _ : state)
+  {
+    if(state.range(0) == 0)
+    {
+      DataTamerParser::ParseSnapshot(
+          schema, view, [&](const std::string&, const DataTamerParser::VarNumber& number) {
+            sum += std::visit([](auto value) { return double(value); }, number);
+          });
+    }
+    else
+    {
+      plan.parse(view, [&](uint32_t, auto value) { sum += double(value); });
+    }
+  }
+  benchmark::DoNotOptimize(sum);
+  state.SetBytesProcessed(int64_t(state.iterations() * view.payload.size));
+}
+
+// Argument: 0 = ParsePlan into vectors, 1 = ColumnarDecoder, in batches of 1000 snapshots
+static void DT_ColumnarDecode(benchmark::State& state)
+{
+  std::array<TestTypes::Pose, 100> poses;
+  std::array<double, 300> values = {};
+
+  auto channel = LogChannel::create("channel");
+  auto sink = std::make_shared<DummySink>();
+  channel->addDataSink(sink);
+  channel->registerValue("poses", &poses);
+  channel->registerValue("values", &values);
+  channel->takeSnapshot();
+  while(sink->getStatistics().stored == 0)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  const auto schema = DataTamerParser::BuilSchemaFromText(ToStr(channel->getSchema()));
+  const Snapshot& snapshot = sink->latest_snapshot;
+  const DataTamerParser::SnapshotView view = {
+    snapshot.schema_hash,
+    uint64_t(snapshot.timestamp.count()),
+    { snapshot.active_mask.data(), snapshot.active_mask.size() },
+    { snapshot.payload.data(), snapshot.payload.size() }
+  };
+  const std::vector<DataTamerParser::SnapshotView> batch(1000, view);
+
+  DataTamerParser::ParsePlan plan(schema);
+  DataTamerParser::ColumnarDecoder decoder(schema);
+  std::vector<std::vector<double>> columns(plan.seriesCount());
+  for(auto _ : state)
+  {
+    if(state.range(0) == 0)
+    {
+      for(auto& column : columns)
+      {
+        column.clear();
+      }
+      for(const auto& snapshot : batch)
+      {
+        plan.parse(snapshot, [&](uint32_t series_id, auto value) {
+          columns[series_id].push_back(double(value));
+        });
+      }
+      benchmark::DoNotOptimize(columns.data());
+    }
+    else
+    {
+      decoder.clear();
+      decoder.append(batch.data(), batch.size());
+      benchmark::DoNotOptimize(decoder.columns().data());
+    }
+  }
+  state.SetBytesProcessed(int64_t(state.iterations() * batch.size() * view.payload.size));
+}
+
 BENCHMARK(DT_Doubles)->Arg(125)->Arg(250)->Arg(500)->Arg(1000)->Arg(2000);
+BENCHMARK(DT_ScalarDoubles)->Arg(125)->Arg(250)->Arg(500)->Arg(1000)->Arg(2000);
 BENCHMARK(DT_PoseType)->Arg(125)->Arg(250)->Arg(500)->Arg(1000);
+BENCHMARK(DT_MCAPWrite)->DenseRange(0, 8)->UseRealTime();
+BENCHMARK(DT_Parse)->Arg(0)->Arg(1)->Arg(2);
+BENCHMARK(DT_ColumnarDecode)->Arg(0)->Arg(1);
+BENCHMARK(DT_Clock)->Arg(0)->Arg(1)->Arg(2);
+BENCHMARK(DT_LoggedValueSet)->ArgsProduct({ { 100, 500 }, { 0, 1 } });
+BENCHMARK(DT_MultiWriter)->ArgsProduct({ { 1, 2, 4 }, { 0, 1 } })->UseRealTime();
 
 BENCHMARK_MAIN();
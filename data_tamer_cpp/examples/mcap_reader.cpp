@@ -24,7 +24,10 @@ int main(int argc, char** argv)
 
   // start reading all the schemas and parsing them
   std::unordered_map<mcap::SchemaId, size_t> schema_id_to_hash;
-  std::unordered_map<size_t, DataTamerParser::Schema> hash_to_schema;
+  // the schemas, compiled to parse the snapshots faster
+  std::unordered_map<size_t, DataTamerParser::ParsePlan> hash_to_plan;
+  // needed only if the snapshots were delta-encoded
+  std::unordered_map<size_t, DataTamerParser::DeltaDecoder> hash_to_decoder;
   // must call this, before accessing the schemas
   auto summary = reader.readSummary(mcap::ReadSummaryMethod::NoFallbackScan);
   for(const auto& [schema_id, mcap_schema] : reader.schemas())
@@ -34,26 +37,14 @@ int main(int argc, char** argv)
 
     auto dt_schema = DataTamerParser::BuilSchemaFromText(schema_text);
     schema_id_to_hash[mcap_schema->id] = dt_schema.hash;
-    hash_to_schema[dt_schema.hash] = dt_schema;
+    hash_to_plan.emplace(dt_schema.hash, DataTamerParser::ParsePlan(dt_schema));
+    hash_to_decoder.emplace(dt_schema.hash, DataTamerParser::DeltaDecoder(dt_schema));
   }
 
   // this application will do nothing with the actual data. We will simple count the
-  // number of messages per time series
-  using MessageCount = std::map<std::string, size_t>;
-  std::map<std::string, MessageCount> message_counts_per_channel;
-
-  auto IncrementCounter = [&](const std::string& series_name,
-                              MessageCount& message_counts) {
-    auto it = message_counts.find(series_name);
-    if(it == message_counts.end())
-    {
-      message_counts[series_name] = 1;
-    }
-    else
-    {
-      it->second++;
-    }
-  };
+  // number of messages per time series. The index of the vector is the series ID
+  using MessageCount = std::vector<size_t>;
+  std::map<std::string, std::pair<size_t, MessageCount>> message_counts_per_channel;
 
   // parse all messages
   for(const auto& msg : reader.readMessages())
@@ -62,7 +53,7 @@ int main(int argc, char** argv)
     DataTamerParser::SnapshotView snapshot;
     snapshot.timestamp = msg.message.logTime;
     snapshot.schema_hash = schema_id_to_hash.at(msg.schema->id);
-    const auto& dt_schema = hash_to_schema.at(snapshot.schema_hash);
+    auto& plan = hash_to_plan.at(snapshot.schema_hash);
 
     // msg_buffer contains both active_mask and payload, serialized
     // one after the other.
@@ -79,25 +70,31 @@ int main(int argc, char** argv)
     snapshot.payload.data = msg_buffer.data;
     snapshot.payload.size = payload_size;
 
-    // prepare the callback to be invoked by ParseSnapshot.
-    // Wrap IncrementCounter to add the channel_name
+    // prepare the callback to be invoked by the ParsePlan.
     const std::string& channel_name = msg.channel->topic;
-    auto& message_counts = message_counts_per_channel[channel_name];
-    auto callback_number = [&](const std::string& series_name,
-                               const DataTamerParser::VarNumber&) {
-      IncrementCounter(series_name, message_counts);
+    auto& [hash, message_counts] = message_counts_per_channel[channel_name];
+    hash = snapshot.schema_hash;
+    auto callback_number = [&](uint32_t series_id, auto) {
+      if(series_id >= message_counts.size())
+      {
+        message_counts.resize(series_id + 1, 0);
+      }
+      message_counts[series_id]++;
     };
 
-    DataTamerParser::ParseSnapshot(dt_schema, snapshot, callback_number);
+    DataTamerParser::SnapshotView decoded;
+    hash_to_decoder.at(snapshot.schema_hash).decode(snapshot, decoded);
+    plan.parse(decoded, callback_number);
   }
 
   // display the counted data samples
-  for(const auto& [channel_name, msg_counts] : message_counts_per_channel)
+  for(const auto& [channel_name, counts] : message_counts_per_channel)
   {
     std::cout << channel_name << ":" << std::endl;
-    for(const auto& [name, count] : msg_counts)
+    const auto& plan = hash_to_plan.at(counts.first);
+    for(uint32_t id = 0; id < counts.second.size(); id++)
     {
-      std::cout << "   " << name << ":" << count << std::endl;
+      std::cout << "   " << plan.seriesName(id) << ":" << counts.second[id] << std::endl;
     }
   }
   return 0;
@@ -1,11 +1,15 @@
 #pragma once
 
 #include "data_tamer/values.hpp"
+#include "data_tamer/clock.hpp"
 #include "data_tamer/data_sink.hpp"
 #include "data_tamer/logged_value.hpp"
+#include "data_tamer/details/seqlock.hpp"
 
 #include <chrono>
 #include <memory>
+#include <optional>
+#include <unordered_set>
 
 namespace DataTamer
 {
@@ -69,6 +73,8 @@ public:
    * If you want to change the pointer T* to a new one,
    * you must first call unregister(), otherwise this method will throw
    * an exception.
+   * Types without TypeDefinition that specialize SerializeMe::is_contiguous_container
+   * are stored as a vector of their elements.
    *
    * @param name   name of the value
    * @param value  pointer to the value
@@ -135,6 +141,19 @@ public:
   [[nodiscard]] std::shared_ptr<LoggedValue<T>> createLoggedValue(std::string const& name,
                                                                   T initial_value = T{});
 
+  /**
+   * @brief createAtomicLoggedValue is similar to createLoggedValue(), but
+   * the value can be modified without locking any mutex. See AtomicLoggedValue for details.
+   *
+   * @param name of the value
+   * @param initial_value  initial value to give to the AtomicLoggedValue
+   *
+   * @return the instance of AtomicLoggedValue, wrapped in a shared_ptr
+   */
+  template <typename T = double>
+  [[nodiscard]] std::shared_ptr<AtomicLoggedValue<T>>
+  createAtomicLoggedValue(std::string const& name, T initial_value = T{});
+
   /// Name of this channel (passed to the constructor)
   [[nodiscard]] const std::string& channelName() const;
 
@@ -148,6 +167,25 @@ public:
   /// NOTE: the unregistered value will not be removed from the Schema
   void unregister(const RegistrationID& id);
 
+  /**
+   * @brief setDeadband allows lossy logging of noisy or slowly varying values.
+   * See Deadband for details. Can be used only with numbers (not vectors).
+   *
+   * @param id        returned by registerValue().
+   * @param deadband  use std::nullopt to record the value in all the snapshots again.
+   */
+  void setDeadband(const RegistrationID& id, std::optional<Deadband> deadband);
+
+  /**
+   * @brief setDecimation records the value only once every [factor] snapshots,
+   * to log signals with different rates in the same channel.
+   * In the other snapshots, the value is marked as not active.
+   *
+   * @param id      returned by registerValue().
+   * @param factor  use 1 to record the value in all the snapshots.
+   */
+  void setDecimation(const RegistrationID& id, size_t factor);
+
   /**
    * @brief addDataSink add a sink, i.e. a class collecting our snapshots.
    */
@@ -157,11 +195,62 @@ public:
    * @brief takeSnapshot copies the current value of all your registered values
    *  and send an instance of Snapshot to all your Sinks.
    *
-   * @param timestamp is the time since epoch, by default.
+   * Multiple threads can call it at the same time: each call uses its own Snapshot,
+   * taken from a pool. The values are copied in parallel, unless deadband,
+   * delta mode or AtomicLoggedValue are used.
+   *
+   * @param timestamp is the time since epoch, usually.
    *
    * @return true is succesfully pushed to all its sinks.
    */
-  bool takeSnapshot(std::chrono::nanoseconds timestamp = NsecSinceEpoch());
+  bool takeSnapshot(std::chrono::nanoseconds timestamp);
+
+  /// Same as above, using the clock of the channel (see setClock) for the timestamp.
+  bool takeSnapshot();
+
+  /**
+   * @brief setClock changes the clock used by takeSnapshot() without arguments.
+   * The default one is SystemClock. Set it before taking snapshots.
+   */
+  void setClock(ClockBase::Ptr clock);
+
+  [[nodiscard]] const ClockBase::Ptr& clock() const;
+
+  /**
+   * @brief setDeltaMode enables the delta encoding of the snapshots: values with
+   * a fixed size (numbers and arrays of numbers) are added to the payload only if
+   * they changed since the previous snapshot.
+   *
+   * A complete snapshot (keyframe) is created every keyframe_interval snapshots,
+   * to allow random access. Each snapshot carries a sequence number: when some are
+   * dropped (by the sinks or the pool), DataTamerParser::DeltaDecoder marks the
+   * values that may have changed as missing, until they are received again or the
+   * next keyframe arrives.
+   * Use DataTamerParser::DeltaDecoder to reconstruct the complete snapshots.
+   * See Snapshot::active_mask for details about the format.
+   */
+  void setDeltaMode(bool enable, size_t keyframe_interval = 100);
+
+  /// Minimum size of the pool, if setSnapshotPoolSize() is not called
+  static constexpr size_t kDefaultSnapshotPoolSize = 1024;
+
+  /**
+   * @brief setSnapshotPoolSize sets the maximum number of snapshots of this channel
+   * that can be waiting to be processed by the sinks at the same time.
+   * Snapshots are shared by all the sinks and their memory is reused, once released.
+   *
+   * If all of them are in use, takeSnapshot() drops the new snapshot and returns false
+   * (see droppedSnapshotsCount()). This bounds the memory used, if a sink is too slow.
+   *
+   * By default, the pool is as large as DataSinkBase::maxPendingSnapshots() of all the
+   * sinks together (at least kDefaultSnapshotPoolSize), so that the OverflowPolicy of
+   * the sinks applies before the pool runs out of snapshots.
+   */
+  void setSnapshotPoolSize(size_t max_snapshots);
+
+  /// Number of snapshots dropped by takeSnapshot(), because all the snapshots
+  /// of the pool were still used by the sinks.
+  [[nodiscard]] uint64_t droppedSnapshotsCount() const;
 
   /**
    * @brief getActiveFlags returns a serialized buffer, where
@@ -184,13 +273,57 @@ public:
   * - the variables are being modified in a thread different than the one calling takeSnapshot()
   *
   * No need to worry about LoggedValues (they use the mutex internally)
+  *
+  * In seqlock mode, use seqLock() instead.
   */
   Mutex& writeMutex();
 
+  /**
+   * @brief setSeqLockMode enables the optimistic synchronization between the
+   * threads modifying the values and takeSnapshot().
+   *
+   * By default, writers lock writeMutex() and wait until takeSnapshot() completes.
+   * In seqlock mode, writers never wait for takeSnapshot(): they only increment the
+   * counters of seqLock() (LoggedValue and MutablePtr do it internally).
+   * takeSnapshot() copies the values and tries again if a writer was active
+   * at the same time. After too many attempts, the snapshot is dropped and
+   * takeSnapshot() returns false (see tornSnapshotsCount()).
+   *
+   * Vectors and custom types must not be resized by the writers, in this mode.
+   * Enable it before the writer threads are started.
+   */
+  void setSeqLockMode(bool enable);
+
+  /**
+   * @brief seqLock should be used with SeqLockWriteGuard to modify the values
+   * registered with registerValue(), if the seqlock mode is enabled.
+   *
+   * @return nullptr if the seqlock mode is disabled.
+   */
+  [[nodiscard]] SeqLock* seqLock();
+
+  /// Number of snapshots dropped in seqlock mode, because the writers were too busy.
+  [[nodiscard]] uint64_t tornSnapshotsCount() const;
+
 private:
   struct Pimpl;
   std::unique_ptr<Pimpl> _p;
 
+  template <typename T>
+  friend class AtomicLoggedValue;
+  friend class ChannelsRegistry;
+
+  // the first part of takeSnapshot(): return an empty pointer if the snapshot was dropped
+  SnapshotPtr createSnapshot(std::chrono::nanoseconds timestamp);
+  // sinks of this channel, not protected by the mutex
+  const std::unordered_set<std::shared_ptr<DataSinkBase>>& sinks() const;
+
+  // The hooks are called by takeSnapshot, before copying the values.
+  // context is also used to identify the hook, when it is removed.
+  using SnapshotHook = void (*)(void* context);
+  void addSnapshotHook(SnapshotHook hook, void* context);
+  void removeSnapshotHook(void* context);
+
   TypesRegistry _type_registry;
 
   template <typename T>
@@ -267,9 +400,12 @@ inline RegistrationID LogChannel::registerValue(const std::string& name,
                                                 const T* value_ptr)
 {
   using namespace SerializeMe;
-  static_assert(has_TypeDefinition<T>() || IsNumericType<T>(), "Missing TypeDefinition");
+  static_assert(has_TypeDefinition<T>() || IsNumericType<T>() ||
+                    is_contiguous_container<T>(),
+                "Missing TypeDefinition");
 
-  if constexpr(IsNumericType<T>())
+  if constexpr(IsNumericType<T>() ||
+               (!has_TypeDefinition<T>() && is_contiguous_container<T>()))
   {
     return registerValueImpl(name, ValuePtr(value_ptr), {});
   }
@@ -333,6 +469,14 @@ LogChannel::createLoggedValue(std::string const& name, T initial_value)
   return std::shared_ptr<LoggedValue<T>>(val);
 }
 
+template <typename T>
+inline std::shared_ptr<AtomicLoggedValue<T>>
+LogChannel::createAtomicLoggedValue(std::string const& name, T initial_value)
+{
+  auto val = new AtomicLoggedValue<T>(shared_from_this(), name, initial_value);
+  return std::shared_ptr<AtomicLoggedValue<T>>(val);
+}
+
 template <typename T>
 inline LoggedValue<T>::LoggedValue(const std::shared_ptr<LogChannel>& channel,
                                    const std::string& name, T initial_value)
@@ -360,6 +504,26 @@ inline void LoggedValue<T>::setEnabled(bool enabled)
   enabled_ = enabled;
 }
 
+template <typename T>
+inline void LoggedValue<T>::setDeadband(std::optional<Deadband> deadband)
+{
+  std::lock_guard lk(rw_mutex_);
+  if(auto channel = channel_.lock())
+  {
+    channel->setDeadband(id_, deadband);
+  }
+}
+
+template <typename T>
+inline void LoggedValue<T>::setDecimation(size_t factor)
+{
+  std::lock_guard lk(rw_mutex_);
+  if(auto channel = channel_.lock())
+  {
+    channel->setDecimation(id_, factor);
+  }
+}
+
 template <typename T>
 inline void LoggedValue<T>::set(const T& val, bool auto_enable)
 {
@@ -367,7 +531,15 @@ inline void LoggedValue<T>::set(const T& val, bool auto_enable)
   std::lock_guard lk(rw_mutex_);
   if(auto channel = channel_.lock())
   {
-    value_ = val;
+    if(SeqLock* seqlock = channel->seqLock())
+    {
+      const SeqLockWriteGuard guard(*seqlock);
+      value_ = val;
+    }
+    else
+    {
+      value_ = val;
+    }
     if(!enabled_ && auto_enable)
     {
       channel->setEnabled(id_, true);
@@ -396,6 +568,11 @@ inline MutablePtr<T> LoggedValue<T>::getMutablePtr()
 {
   if(auto channel = channel_.lock())
   {
+    if(SeqLock* seqlock = channel->seqLock())
+    {
+      // takeSnapshot doesn't lock writeMutex: only other users of this value do
+      return MutablePtr<T>(&value_, &rw_mutex_, seqlock);
+    }
     return MutablePtr<T>(&value_, &channel->writeMutex());
   }
   return MutablePtr<T>(&value_, nullptr);
@@ -406,9 +583,102 @@ inline ConstPtr<T> LoggedValue<T>::getConstPtr()
 {
   if(auto channel = channel_.lock())
   {
+    if(channel->seqLock())
+    {
+      return ConstPtr<T>(&value_, &rw_mutex_);
+    }
     return ConstPtr<T>(&value_, &channel->writeMutex());
   }
   return ConstPtr<T>(&value_, nullptr);
 }
 
+//----------------------------------------------------------------------
+
+template <typename T>
+inline AtomicLoggedValue<T>::AtomicLoggedValue(const std::shared_ptr<LogChannel>& channel,
+                                               const std::string& name, T initial_value)
+  : channel_(channel)
+  , storage_(initial_value)
+  , snapshot_value_(initial_value)
+  , id_(channel->registerValue(name, &snapshot_value_))
+{
+  channel->addSnapshotHook(&AtomicLoggedValue::copyLatest, this);
+}
+
+template <typename T>
+inline AtomicLoggedValue<T>::~AtomicLoggedValue()
+{
+  if(auto channel = channel_.lock())
+  {
+    channel->removeSnapshotHook(this);
+    channel->unregister(id_);
+  }
+}
+
+template <typename T>
+inline void AtomicLoggedValue<T>::copyLatest(void* self)
+{
+  auto* value = static_cast<AtomicLoggedValue*>(self);
+  if constexpr(kUseAtomic)
+  {
+    value->snapshot_value_ = value->storage_.load(std::memory_order_acquire);
+  }
+  else
+  {
+    value->storage_.read(value->snapshot_value_);
+  }
+}
+
+template <typename T>
+inline void AtomicLoggedValue<T>::set(const T& val, bool auto_enable)
+{
+  if constexpr(kUseAtomic)
+  {
+    storage_.store(val, std::memory_order_release);
+  }
+  else
+  {
+    storage_.write(val);
+  }
+  if(auto_enable && !enabled_.load(std::memory_order_relaxed))
+  {
+    setEnabled(true);
+  }
+}
+
+template <typename T>
+inline T AtomicLoggedValue<T>::get() const
+{
+  static_assert(kUseAtomic, "get() can not be used with a TripleBuffer");
+  return storage_.load(std::memory_order_acquire);
+}
+
+template <typename T>
+inline void AtomicLoggedValue<T>::setEnabled(bool enabled)
+{
+  if(auto channel = channel_.lock())
+  {
+    channel->setEnabled(id_, enabled);
+  }
+  enabled_ = enabled;
+}
+
+template <typename T>
+inline void AtomicLoggedValue<T>::setDeadband(std::optional<Deadband> deadband)
+{
+  if(auto channel = channel_.lock())
+  {
+    channel->setDeadband(id_, deadband);
+  }
+}
+
+template <typename T>
+inline void AtomicLoggedValue<T>::setDecimation(size_t factor)
+{
+  if(auto channel = channel_.lock())
+  {
+    channel->setDecimation(id_, factor);
+  }
+}
+
 }  // namespace DataTamer
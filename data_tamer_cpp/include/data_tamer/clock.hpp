@@ -0,0 +1,96 @@
+#pragma once
+
+#include "data_tamer/details/seqlock.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+namespace DataTamer
+{
+
+/**
+ * @brief ClockBase is the interface of the clocks used by LogChannel::takeSnapshot()
+ * and ChannelsRegistry to timestamp the snapshots.
+ * Implementations must be thread-safe.
+ */
+class ClockBase
+{
+public:
+  using Ptr = std::shared_ptr<ClockBase>;
+
+  virtual ~ClockBase() = default;
+
+  /// current time, in nanoseconds since the epoch of this clock.
+  [[nodiscard]] virtual std::chrono::nanoseconds now() = 0;
+};
+
+/// std::chrono::system_clock: nanoseconds since the UNIX epoch (default).
+class SystemClock : public ClockBase
+{
+public:
+  [[nodiscard]] std::chrono::nanoseconds now() override;
+};
+
+/// std::chrono::steady_clock: monotonic, but its epoch is not specified (usually the boot time).
+class SteadyClock : public ClockBase
+{
+public:
+  [[nodiscard]] std::chrono::nanoseconds now() override;
+};
+
+/**
+ * @brief TSCClock reads the Time Stamp Counter of the CPU (a few nanoseconds)
+ * and converts it into nanoseconds since the UNIX epoch.
+ *
+ * The frequency of the TSC is calibrated against std::chrono::system_clock
+ * when the clock is created. Then, the conversion is periodically synchronized
+ * again with the system clock, to follow its adjustments (NTP).
+ * Each synchronization may cause a small step of the timestamps.
+ *
+ * Use IsAvailable() to check if the CPU has an invariant TSC (x86_64 only).
+ * If it doesn't, now() falls back to std::chrono::system_clock.
+ */
+class TSCClock : public ClockBase
+{
+public:
+  /**
+   * @param resync_period     how often the conversion is synchronized with the system clock.
+   * @param calibration_time  duration of the initial calibration, done in the constructor.
+   */
+  explicit TSCClock(std::chrono::nanoseconds resync_period = std::chrono::seconds(1),
+                    std::chrono::nanoseconds calibration_time = std::chrono::milliseconds(10));
+
+  /// true if the CPU has an invariant TSC
+  [[nodiscard]] static bool IsAvailable();
+
+  [[nodiscard]] std::chrono::nanoseconds now() override;
+
+  /// frequency of the TSC, estimated by the latest synchronization
+  [[nodiscard]] double ticksPerNanosecond();
+
+private:
+  // conversion from TSC to nanoseconds
+  struct Conversion
+  {
+    uint64_t base_tsc = 0;
+    int64_t base_nsec = 0;
+    double nsec_per_tick = 0;
+  };
+
+  Conversion loadConversion() const;
+  void resync(uint64_t tsc);
+
+  bool available_ = false;
+  uint64_t resync_ticks_ = 0;
+  // reference point of the first calibration, used to refine the frequency
+  uint64_t first_tsc_ = 0;
+  int64_t first_nsec_ = 0;
+
+  mutable SeqLock seqlock_;
+  Conversion conversion_;
+  std::atomic_bool resyncing_ = false;
+};
+
+}  // namespace DataTamer
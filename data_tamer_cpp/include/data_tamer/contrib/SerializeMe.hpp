@@ -109,6 +109,9 @@ template <
     std::enable_if_t<!has_TypeDefinition<Container<T, TArgs...>>::value, bool> = true>
 size_t BufferSize(const Container<T, TArgs...>& vect);
 
+template <typename T>
+size_t BufferSize(const Span<T>& values);
+
 //---------- Forward declarations of DeserializeFromBuffer -----------
 
 template <typename T, bool = true>
@@ -143,6 +146,9 @@ template <
     std::enable_if_t<!has_TypeDefinition<Container<T, TArgs...>>::value, bool> = true>
 void SerializeIntoBuffer(SpanBytes& buffer, const Container<T, TArgs...>& vect);
 
+template <typename T>
+void SerializeIntoBuffer(SpanBytes& buffer, const Span<T>& values);
+
 //-----------------------------------------------------------------------
 //-----------------------------------------------------------------------
 //-----------------------------------------------------------------------
@@ -318,6 +324,106 @@ inline constexpr bool is_vector()
   return (is_std_vector<T>::value || is_std_array<T>::value);
 }
 
+// Types that store their elements in contiguous memory and expose the methods
+// data() and size(). If the elements are numbers, they are serialized with a single
+// memcpy (byte-swapped on big-endian hosts).
+//
+// std::vector and std::array are detected automatically; specialize this trait to
+// opt-in other types, for instance Eigen matrices. Opted-in types are serialized
+// like a dynamic vector: size as uint32_t, followed by the elements.
+template <typename T>
+struct is_contiguous_container
+  : std::bool_constant<is_vector<T>() && !std::is_same_v<T, std::vector<bool>>>
+{
+};
+
+template <typename T>
+using contiguous_value_t =
+    std::remove_cv_t<std::remove_pointer_t<decltype(std::declval<const T&>().data())>>;
+
+template <typename T, class = void>
+struct has_resize : std::false_type
+{
+};
+
+template <typename T>
+struct has_resize<T, std::void_t<decltype(std::declval<T&>().resize(size_t(0)))>>
+  : std::true_type
+{
+};
+
+// Serialize [count] numbers with a single bounds check.
+template <typename T>
+inline void SerializeArrayIntoBuffer(SpanBytes& buffer, const T* values, size_t count)
+{
+  static_assert(is_number<T>(), "Only numbers can be serialized in bulk");
+  const size_t size = count * sizeof(T);
+  if(size > buffer.size())
+  {
+    throw std::runtime_error("SerializeIntoBuffer: buffer overflow");
+  }
+  if(size == 0)
+  {
+    return;
+  }
+#if SERIALIZE_LITTLEENDIAN == 0
+  if constexpr(sizeof(T) > 1)
+  {
+    // simple loop without branches, that the compiler can vectorize
+    using Raw = std::conditional_t<sizeof(T) == 2, uint16_t,
+                                   std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>;
+    uint8_t* dst = buffer.data();
+    for(size_t i = 0; i < count; i++)
+    {
+      Raw raw;
+      std::memcpy(&raw, &values[i], sizeof(T));
+      raw = EndianSwap<Raw>(raw);
+      std::memcpy(dst + i * sizeof(T), &raw, sizeof(T));
+    }
+  }
+  else
+  {
+    std::memcpy(buffer.data(), values, size);
+  }
+#else
+  std::memcpy(buffer.data(), values, size);
+#endif
+  buffer.trimFront(size);
+}
+
+// Deserialize [count] numbers with a single bounds check.
+template <typename T>
+inline void DeserializeArrayFromBuffer(SpanBytesConst& buffer, T* values, size_t count)
+{
+  static_assert(is_number<T>(), "Only numbers can be deserialized in bulk");
+  const size_t size = count * sizeof(T);
+  if(size > buffer.size())
+  {
+    throw std::runtime_error("DeserializeFromBuffer: buffer overflow");
+  }
+  if(size == 0)
+  {
+    return;
+  }
+  std::memcpy(values, buffer.data(), size);
+#if SERIALIZE_LITTLEENDIAN == 0
+  if constexpr(sizeof(T) > 1)
+  {
+    using Raw = std::conditional_t<sizeof(T) == 2, uint16_t,
+                                   std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>;
+    auto* raw_values = reinterpret_cast<uint8_t*>(values);
+    for(size_t i = 0; i < count; i++)
+    {
+      Raw raw;
+      std::memcpy(&raw, raw_values + i * sizeof(T), sizeof(T));
+      raw = EndianSwap<Raw>(raw);
+      std::memcpy(raw_values + i * sizeof(T), &raw, sizeof(T));
+    }
+  }
+#endif
+  buffer.trimFront(size);
+}
+
 //-----------------------------------------------------------------------
 //-----------------------------------------------------------------------
 //-----------------------------------------------------------------------
@@ -325,12 +431,17 @@ inline constexpr bool is_vector()
 template <typename T, bool>
 inline size_t BufferSize(const T& val)
 {
-  static_assert(is_number<T>() || has_TypeDefinition<T>(), "Missing TypeDefinition");
+  static_assert(is_number<T>() || has_TypeDefinition<T>() || is_contiguous_container<T>(),
+                "Missing TypeDefinition");
 
   if constexpr(is_number<T>())
   {
     return sizeof(T);
   }
+  else if constexpr(!has_TypeDefinition<T>() && is_contiguous_container<T>())
+  {
+    return sizeof(uint32_t) + size_t(val.size()) * BufferSize(contiguous_value_t<T>{});
+  }
   else
   {
     size_t total_size = 0;
@@ -356,6 +467,12 @@ inline size_t BufferSize(const std::array<T, N>&)
   return BufferSize(T{}) * N;
 }
 
+template <typename T>
+inline size_t BufferSize(const Span<T>& values)
+{
+  return sizeof(uint32_t) + values.size() * BufferSize(std::remove_cv_t<T>{});
+}
+
 template <template <class, class> class Container, class T, class... TArgs,
           std::enable_if_t<!has_TypeDefinition<Container<T, TArgs...>>::value, bool>>
 inline size_t BufferSize(const Container<T, TArgs...>& vect)
@@ -382,7 +499,8 @@ inline size_t BufferSize(const Container<T, TArgs...>& vect)
 template <typename T, bool>
 inline void DeserializeFromBuffer(SpanBytesConst& buffer, T& dest)
 {
-  static_assert(is_number<T>() || has_TypeDefinition<T>(), "Missing TypeDefinition");
+  static_assert(is_number<T>() || has_TypeDefinition<T>() || is_contiguous_container<T>(),
+                "Missing TypeDefinition");
 
   if constexpr(is_number<T>())
   {
@@ -398,6 +516,24 @@ inline void DeserializeFromBuffer(SpanBytesConst& buffer, T& dest)
 #endif
     buffer = SpanBytesConst(buffer.data() + S, buffer.size() - S);  // NOLINT
   }
+  else if constexpr(!has_TypeDefinition<T>() && is_contiguous_container<T>())
+  {
+    uint32_t num_values = 0;
+    DeserializeFromBuffer(buffer, num_values);
+    if constexpr(has_resize<T>())
+    {
+      if(size_t(num_values) * sizeof(contiguous_value_t<T>) > buffer.size())
+      {
+        throw std::runtime_error("DeserializeFromBuffer: buffer overflow");
+      }
+      dest.resize(num_values);
+    }
+    else if(size_t(dest.size()) != num_values)
+    {
+      throw std::runtime_error("DeserializeFromBuffer: wrong size in static container");
+    }
+    DeserializeArrayFromBuffer(buffer, dest.data(), num_values);
+  }
   else
   {
     auto func = [&buffer](const char*, const auto* field) {
@@ -426,18 +562,16 @@ template <typename T, size_t N,
           std::enable_if_t<!has_TypeDefinition<std::array<T, N>>::value, bool>>
 inline void DeserializeFromBuffer(SpanBytesConst& buffer, std::array<T, N>& dest)
 {
-  if(N * BufferSize(T{}) > buffer.size())
-  {
-    throw std::runtime_error("DeserializeFromBuffer: buffer overflow");
-  }
-
-  if constexpr(sizeof(T) == 1)
+  if constexpr(is_number<T>())
   {
-    memcpy(dest.data(), buffer.data(), N);
-    buffer.trimFront(N);
+    DeserializeArrayFromBuffer(buffer, dest.data(), N);
   }
   else
   {
+    if(N * BufferSize(T{}) > buffer.size())
+    {
+      throw std::runtime_error("DeserializeFromBuffer: buffer overflow");
+    }
     for(size_t i = 0; i < N; i++)
     {
       DeserializeFromBuffer(buffer, dest[i]);
@@ -453,23 +587,15 @@ inline void DeserializeFromBuffer(SpanBytesConst& buffer, Container<T, TArgs...>
   DeserializeFromBuffer(buffer, num_values);
 
   // if the container offers contiguous memory, you can just use memcpy
-  if constexpr(sizeof(T) == 1 && is_vector<Container<T, TArgs...>>())
+  if constexpr(is_number<T>() && is_contiguous_container<Container<T, TArgs...>>())
   {
-    if constexpr(container_info<Container<T, TArgs...>>::size == 0)
+    // check before resizing, to avoid huge allocations if the buffer is corrupted
+    if(size_t(num_values) * sizeof(T) > buffer.size())
     {
-      dest.resize(num_values);
-    }
-    else if constexpr(std::is_array_v<Container<T, TArgs...>>)
-    {
-      if(std::size(dest) != num_values)
-      {
-        throw std::runtime_error("DeserializeFromBuffer: wrong size in static container");
-      }
+      throw std::runtime_error("DeserializeFromBuffer: buffer overflow");
     }
-
-    const size_t size = num_values * BufferSize(T{});
-    memcpy(dest.data(), buffer.data(), size);
-    buffer.trimFront(size);
+    dest.resize(num_values);
+    DeserializeArrayFromBuffer(buffer, dest.data(), num_values);
   }
   else
   {
@@ -490,7 +616,8 @@ inline void DeserializeFromBuffer(SpanBytesConst& buffer, Container<T, TArgs...>
 template <typename T, bool>
 inline void SerializeIntoBuffer(SpanBytes& buffer, T const& value)
 {
-  static_assert(is_number<T>() || has_TypeDefinition<T>(), "Missing TypeDefinition");
+  static_assert(is_number<T>() || has_TypeDefinition<T>() || is_contiguous_container<T>(),
+                "Missing TypeDefinition");
 
   if constexpr(is_number<T>())
   {
@@ -507,6 +634,16 @@ inline void SerializeIntoBuffer(SpanBytes& buffer, T const& value)
 #endif
     buffer.trimFront(S);  // NOLINT
   }
+  else if constexpr(!has_TypeDefinition<T>() && is_contiguous_container<T>())
+  {
+    const size_t num_values = size_t(value.size());
+    if(num_values > std::numeric_limits<uint32_t>::max())
+    {
+      throw std::runtime_error("SerializeIntoBuffer: container exceeds maximum size");
+    }
+    SerializeIntoBuffer(buffer, static_cast<uint32_t>(num_values));
+    SerializeArrayIntoBuffer(buffer, value.data(), num_values);
+  }
   else
   {
     auto func = [&buffer](const char*, const auto* field) {
@@ -545,18 +682,9 @@ inline void SerializeIntoBuffer(SpanBytes& buffer, std::array<T, N> const& vect)
     throw std::runtime_error("SerializeIntoBuffer: array exceeds maximum size");
   }
 
-  if constexpr(std::is_arithmetic_v<T> || std::is_same_v<T, std::byte>)
-  {
-    if(N * sizeof(T) > buffer.size())
-    {
-      throw std::runtime_error("SerializeIntoBuffer: buffer overflow");
-    }
-  }
-
-  if constexpr(sizeof(T) == 1)
+  if constexpr(is_number<T>())
   {
-    std::memcpy(vect.data(), buffer.data(), N);
-    buffer.trimFront(N);
+    SerializeArrayIntoBuffer(buffer, vect.data(), N);
   }
   else
   {
@@ -574,16 +702,10 @@ inline void SerializeIntoBuffer(SpanBytes& buffer, Container<T, TArgs...> const&
   const auto num_values = static_cast<uint32_t>(vect.size());
   SerializeIntoBuffer(buffer, num_values);
 
-  // can use memcpy if the size of T is 1
-  if constexpr(sizeof(T) == 1 && is_vector<Container<T, TArgs...>>())
+  // if the container offers contiguous memory, you can just use memcpy
+  if constexpr(is_number<T>() && is_contiguous_container<Container<T, TArgs...>>())
   {
-    const size_t size = num_values;
-    if(size > buffer.size())
-    {
-      throw std::runtime_error("SerializeIntoBuffer: buffer overflow");
-    }
-    memcpy(buffer.data(), vect.data(), size);
-    buffer.trimFront(size);
+    SerializeArrayIntoBuffer(buffer, vect.data(), num_values);
   }
   else
   {
@@ -594,4 +716,27 @@ inline void SerializeIntoBuffer(SpanBytes& buffer, Container<T, TArgs...> const&
   }
 }
 
+template <typename T>
+inline void SerializeIntoBuffer(SpanBytes& buffer, const Span<T>& values)
+{
+  using Type = std::remove_cv_t<T>;
+  if(values.size() > std::numeric_limits<uint32_t>::max())
+  {
+    throw std::runtime_error("SerializeIntoBuffer: span exceeds maximum size");
+  }
+  SerializeIntoBuffer(buffer, static_cast<uint32_t>(values.size()));
+
+  if constexpr(is_number<Type>())
+  {
+    SerializeArrayIntoBuffer<Type>(buffer, values.data(), values.size());
+  }
+  else
+  {
+    for(size_t i = 0; i < values.size(); i++)
+    {
+      SerializeIntoBuffer(buffer, values.data()[i]);
+    }
+  }
+}
+
 }  // namespace SerializeMe
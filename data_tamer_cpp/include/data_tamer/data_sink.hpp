@@ -1,9 +1,12 @@
 #pragma once
 
 #include "data_tamer/types.hpp"
+#include "data_tamer/contrib/SerializeMe.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <string_view>
@@ -17,6 +20,8 @@ using PayloadVector = std::vector<uint8_t>;
 
 bool GetBit(const ActiveMask& mask, size_t index);
 void SetBit(ActiveMask& mask, size_t index, bool val);
+/// Clear in mask all the bits set in [bits] (same size), 64 bits at a time
+void ClearBits(ActiveMask& mask, const ActiveMask& bits);
 
 struct Snapshot
 {
@@ -31,12 +36,25 @@ struct Snapshot
   /// Vector that tell us if a field of the schema is
   /// active or not. It is basically an optimized vector
   /// of bools, where each byte contains 8 boolean flags.
+  ///
+  /// Delta snapshots (see LogChannel::setDeltaMode) have a mask twice as large:
+  /// the first half tells which fields are in the payload and the second half
+  /// which fields are active. Active fields missing in the payload didn't change.
+  /// In delta mode, the mask of all the snapshots (keyframes included) is followed
+  /// by a uint32 sequence number, incremented at each snapshot of the channel.
   ActiveMask active_mask;
 
   /// serialized dat containing all the values, ordered as in the schema
   PayloadVector payload;
 };
 
+/// Snapshots are shared by all the sinks of a channel without copying them.
+/// The memory is returned to the pool of the channel when the last sink releases it.
+using SnapshotPtr = std::shared_ptr<const Snapshot>;
+
+/// Batch of snapshots popped at once from the queue of a sink
+using SnapshotsSpan = SerializeMe::Span<const SnapshotPtr>;
+
 /**
  * @brief The DataSnapshot contains all the information passed by
  * LogChannel::takeSnapshot to a DataSink.
@@ -48,6 +66,28 @@ struct Snapshot
  */
 using DataSnapshot = std::vector<uint8_t>;
 
+/// What to do when the queue of a sink is full
+enum class OverflowPolicy : uint8_t
+{
+  /// discard the new snapshot; pushSnapshot() returns false
+  DROP_NEWEST,
+  /// discard the oldest snapshot in the queue (ring buffer semantic)
+  DROP_OLDEST,
+  /// pushSnapshot() waits until there is space in the queue or the timeout expires
+  BLOCK
+};
+
+/// Counters of a sink. They are updated atomically and can be read from any thread.
+struct SinkStatistics
+{
+  /// snapshots accepted into the queue
+  uint64_t enqueued = 0;
+  /// snapshots discarded because the queue was full
+  uint64_t dropped = 0;
+  /// snapshots passed to storeSnapshots() by the consumer thread
+  uint64_t stored = 0;
+};
+
 /**
  * @brief The DataSinkBase is the base class to use to create
  * your own DataSink
@@ -78,11 +118,56 @@ public:
    * @brief pushSnapshot will push the data into a concurrent queue,
    * that a different thread will consume, using storeSnapshot()
    *
-   * @param snapshot see type Snapshot for details
+   * @param snapshot see type Snapshot for details. It is shared (not copied)
+   * with the other sinks and must not be modified.
    *
    * @return false if the queue is full and snapshot was not pushed
    */
-  virtual bool pushSnapshot(const Snapshot& snapshot);
+  virtual bool pushSnapshot(const SnapshotPtr& snapshot);
+
+  /// Same as above, but the snapshot is copied. Prefer the version using SnapshotPtr.
+  /// Not virtual: derived classes must override pushSnapshot(const SnapshotPtr&).
+  bool pushSnapshot(const Snapshot& snapshot);
+
+  /**
+   * @brief pushSnapshots pushes multiple snapshots at once (see
+   * ChannelsRegistry::takeSnapshot). If there is enough space in the queue,
+   * they are enqueued together and the consumer thread will usually receive them
+   * in the same call to storeSnapshots(). Otherwise, they are pushed one by one,
+   * using pushSnapshot().
+   *
+   * @return false if any of them was not pushed
+   */
+  virtual bool pushSnapshots(SnapshotsSpan snapshots);
+
+  /// Default value of setQueueCapacity(). Memory for this number of
+  /// snapshots is preallocated when the sink is created.
+  static constexpr size_t kDefaultQueueCapacity = 4096;
+
+  /// Maximum number of snapshots waiting in the queue to be stored.
+  /// If it is larger than kDefaultQueueCapacity, the memory is preallocated by this call.
+  void setQueueCapacity(size_t capacity);
+
+  /**
+   * @brief maxPendingSnapshots is the maximum number of snapshots that this sink
+   * can hold at the same time: the ones in the queue and the batch being stored.
+   * LogChannel uses it to size its pool (see LogChannel::setSnapshotPoolSize).
+   * Override it if the derived class keeps the snapshots for longer.
+   */
+  [[nodiscard]] virtual size_t maxPendingSnapshots() const;
+
+  /**
+   * @brief setOverflowPolicy changes what happens when pushSnapshot() is called
+   * and the queue is full. Default is OverflowPolicy::DROP_NEWEST.
+   *
+   * @param policy         see OverflowPolicy
+   * @param block_timeout  maximum time pushSnapshot() can wait, used
+   *                       only by OverflowPolicy::BLOCK
+   */
+  void setOverflowPolicy(OverflowPolicy policy,
+                         std::chrono::microseconds block_timeout = std::chrono::milliseconds(10));
+
+  [[nodiscard]] SinkStatistics getStatistics() const;
 
 protected:
   /**
@@ -94,6 +179,40 @@ protected:
    */
   virtual bool storeSnapshot(const Snapshot& snapshot) = 0;
 
+  /**
+   * @brief storeSnapshots is invoked by the consumer thread with all the snapshots
+   * that were popped from the queue at once. Override it to amortize locking
+   * or I/O over the batch. By default, it calls storeSnapshot() for each of them.
+   *
+   * @param snapshots batch of snapshots, in the same order they were pushed.
+   * @return true if all of them were processed successfully
+   */
+  virtual bool storeSnapshots(SnapshotsSpan snapshots);
+
+  /**
+   * @brief waitQueueDrained blocks until all the snapshots pushed before this call
+   * were passed to storeSnapshots() (or discarded by OverflowPolicy::DROP_OLDEST).
+   *
+   * @return false if the timeout expired first.
+   */
+  bool waitQueueDrained(std::chrono::milliseconds timeout) const;
+
+  /**
+   * @brief updateStatistics must be called by the derived classes that override
+   * pushSnapshot() to store the snapshots directly, without using the queue.
+   *
+   * @param stored   snapshots stored (they are also counted as enqueued)
+   * @param dropped  snapshots discarded
+   */
+  void updateStatistics(uint64_t stored, uint64_t dropped);
+
+  /**
+   * @brief onIdle is invoked by the consumer thread when no snapshot was received
+   * for a while (about 100 milliseconds), but never before the first snapshot.
+   * Override it to do periodic work, such as flushing buffered data.
+   */
+  virtual void onIdle() {}
+
   void stopThread();
 
 private:
@@ -121,4 +240,23 @@ inline void SetBit(ActiveMask& mask, size_t index, bool value)
   }
 }
 
+inline void ClearBits(ActiveMask& mask, const ActiveMask& bits)
+{
+  const size_t size = std::min(mask.size(), bits.size());
+  size_t i = 0;
+  for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+  {
+    uint64_t word = 0;
+    uint64_t clear = 0;
+    std::memcpy(&word, mask.data() + i, sizeof(uint64_t));
+    std::memcpy(&clear, bits.data() + i, sizeof(uint64_t));
+    word &= ~clear;
+    std::memcpy(mask.data() + i, &word, sizeof(uint64_t));
+  }
+  for(; i < size; i++)
+  {
+    mask[i] &= uint8_t(~bits[i]);
+  }
+}
+
 }  // namespace DataTamer
@@ -2,9 +2,28 @@
 
 #include "data_tamer/channel.hpp"
 
+#include <chrono>
+#include <optional>
+#include <vector>
+
 namespace DataTamer
 {
 
+/// Statistics of a channel, snapshotted periodically by ChannelsRegistry::schedule()
+struct ScheduleStatistics
+{
+  // snapshots taken successfully
+  uint64_t snapshots = 0;
+  // snapshots where takeSnapshot() returned false
+  uint64_t failed = 0;
+  // periods skipped, because the previous snapshots took too long
+  uint64_t overruns = 0;
+  // delay between the deadline and the wake-up of the scheduler, the same for
+  // all the channels with the same period
+  std::chrono::nanoseconds max_jitter = {};
+  std::chrono::nanoseconds mean_jitter = {};
+};
+
 class ChannelsRegistry
 {
 public:
@@ -23,9 +42,58 @@ public:
   /// Create a new channel or get a previously create one.
   [[nodiscard]] std::shared_ptr<LogChannel> getChannel(std::string const& channel_name);
 
-  /// remove all channels and stored sinks
+  /**
+   * @brief takeSnapshot of a group of channels, all with the same timestamp.
+   *
+   * The snapshots of the group are passed to each sink at once
+   * (see DataSinkBase::pushSnapshots), to store them adjacently.
+   *
+   * @return true if the snapshots of all the channels were taken and pushed successfully.
+   */
+  bool takeSnapshot(const std::vector<std::shared_ptr<LogChannel>>& group,
+                    std::chrono::nanoseconds timestamp);
+
+  /// Same as above, using the clock of the registry (see setClock) for the timestamp.
+  bool takeSnapshot(const std::vector<std::shared_ptr<LogChannel>>& group);
+
+  /**
+   * @brief setClock changes the clock used by the scheduler, by takeSnapshot(group)
+   * and by the channels created after this call (see LogChannel::setClock).
+   * The default one is SystemClock.
+   */
+  void setClock(ClockBase::Ptr clock);
+
+  /// remove all channels and stored sinks. The scheduled channels are removed too.
   void clear();
 
+  /**
+   * @brief schedule takes a snapshot of a channel periodically, using a thread
+   * owned by the registry, instead of a loop written by the user.
+   *
+   * The deadlines are absolute: the rate doesn't drift, even if a snapshot is late.
+   * Channels with the same period are snapshotted together and share the same timestamp.
+   * Calling this method again changes the period of the channel.
+   *
+   * @param channel_name  the channel is created, if it doesn't exist.
+   * @param period        must be larger than zero.
+   */
+  void schedule(std::string const& channel_name, std::chrono::nanoseconds period);
+
+  /// Stop taking snapshots of this channel periodically.
+  void unschedule(std::string const& channel_name);
+
+  /// Return std::nullopt if the channel is not scheduled.
+  [[nodiscard]] std::optional<ScheduleStatistics>
+  getScheduleStatistics(std::string const& channel_name) const;
+
+  /**
+   * @brief setSchedulerAffinity pins the thread used by schedule() to a CPU.
+   *
+   * @param cpu  index of the CPU. Use -1 to allow any CPU.
+   * @return false if not supported by the operating system.
+   */
+  bool setSchedulerAffinity(int cpu);
+
 private:
   struct Pimpl;
   std::unique_ptr<Pimpl> _p;
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "data_tamer/details/seqlock.hpp"
+
 #include <shared_mutex>
+#include <utility>
 
 using Mutex = std::shared_mutex;
 
@@ -34,12 +37,14 @@ private:
  * @brief The ConstPtr is a wrapper to a
  * pointer that locks a mutex in the constructor
  * and unlocks it in the destructor.
+ * If a SeqLock is passed, it is also used to notify the readers
+ * that the object is being modified.
  */
 template <typename T>
 class MutablePtr
 {
 public:
-  MutablePtr(T* obj, Mutex* mutex);
+  MutablePtr(T* obj, Mutex* mutex, DataTamer::SeqLock* seqlock = nullptr);
   MutablePtr(const MutablePtr&) = delete;
   MutablePtr& operator=(const MutablePtr&) = delete;
   MutablePtr(MutablePtr&&);
@@ -53,7 +58,8 @@ public:
 
 private:
   T* obj_ = nullptr;
-  Mutex* mutex_;
+  Mutex* mutex_ = nullptr;
+  DataTamer::SeqLock* seqlock_ = nullptr;
 };
 
 //----------------------------------------------------
@@ -117,18 +123,25 @@ inline const T* ConstPtr<T>::operator->() const
 //----------------------------------------------------
 
 template <typename T>
-inline MutablePtr<T>::MutablePtr(T* obj, Mutex *mutex) : obj_(obj), mutex_(mutex)
+inline MutablePtr<T>::MutablePtr(T* obj, Mutex *mutex, DataTamer::SeqLock* seqlock)
+  : obj_(obj), mutex_(mutex), seqlock_(seqlock)
 {
   if(mutex_)
   {
     mutex_->lock();
   }
+  if(seqlock_)
+  {
+    seqlock_->writeBegin();
+  }
 }
 
 template <typename T>
 inline MutablePtr<T>::MutablePtr(MutablePtr&& other) : mutex_(other.mutex_)
 {
   std::swap(obj_, other.obj_);
+  // the counter must be incremented only once
+  std::swap(seqlock_, other.seqlock_);
 }
 
 template <typename T>
@@ -136,12 +149,17 @@ inline MutablePtr<T>& MutablePtr<T>::operator=(MutablePtr<T>&& other)
 {
   mutex_ = other.mutex_;
   std::swap(obj_, other.obj_);
+  std::swap(seqlock_, other.seqlock_);
   return *this;
 }
 
 template <typename T>
 inline MutablePtr<T>::~MutablePtr()
 {
+  if(seqlock_)
+  {
+    seqlock_->writeEnd();
+  }
   if(mutex_)
   {
     mutex_->unlock();
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace DataTamer
+{
+
+/**
+ * @brief SeqLock is a sequence lock that allows multiple writers and an optimistic
+ * reader. Writers never wait: they only increment two counters around their update.
+ * The reader copies the data and retries if a writer was active in the meantime.
+ *
+ * Writers must still avoid modifying the same value concurrently.
+ */
+class SeqLock
+{
+public:
+  void writeBegin()
+  {
+    begin_.fetch_add(1, std::memory_order_relaxed);
+    // the data must not be modified before the counter is incremented
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  void writeEnd() { end_.fetch_add(1, std::memory_order_release); }
+
+  /**
+   * @brief readBegin must be called before copying the data.
+   *
+   * @param token   to be passed to readValidate()
+   * @return false if a writer is active. The data must not be read.
+   */
+  bool readBegin(uint64_t& token) const
+  {
+    const uint64_t end = end_.load(std::memory_order_acquire);
+    token = begin_.load(std::memory_order_acquire);
+    return token == end;
+  }
+
+  /// @return true if no writer modified the data since readBegin()
+  bool readValidate(uint64_t token) const
+  {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return begin_.load(std::memory_order_relaxed) == token;
+  }
+
+private:
+  std::atomic_uint64_t begin_ = 0;
+  std::atomic_uint64_t end_ = 0;
+};
+
+/// RAII wrapper of SeqLock::writeBegin() and SeqLock::writeEnd()
+class SeqLockWriteGuard
+{
+public:
+  explicit SeqLockWriteGuard(SeqLock& seqlock) : seqlock_(seqlock) { seqlock_.writeBegin(); }
+  ~SeqLockWriteGuard() { seqlock_.writeEnd(); }
+
+  SeqLockWriteGuard(const SeqLockWriteGuard&) = delete;
+  SeqLockWriteGuard& operator=(const SeqLockWriteGuard&) = delete;
+
+private:
+  SeqLock& seqlock_;
+};
+
+}  // namespace DataTamer
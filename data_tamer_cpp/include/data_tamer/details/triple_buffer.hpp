@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace DataTamer
+{
+
+/**
+ * @brief TripleBuffer allows a single writer and a single reader to exchange
+ * the latest value of an object without ever waiting for each other.
+ *
+ * The writer owns the "back" buffer, the reader the "front" one. The third buffer
+ * is the latest published value: write() and read() exchange their own buffer
+ * with it, using a single atomic operation.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+  TripleBuffer(const T& initial_value = T{})
+  {
+    buffers_.fill(initial_value);
+  }
+
+  /// Called only by the writer thread.
+  void write(const T& value)
+  {
+    buffers_[back_] = value;
+    back_ = middle_.exchange(back_ | kFreshBit, std::memory_order_acq_rel) & kIndexMask;
+  }
+
+  /**
+   * @brief read the latest published value. Called only by the reader thread.
+   *
+   * @return false if nothing was published since the previous call;
+   * in this case, value contains again the previous one.
+   */
+  bool read(T& value)
+  {
+    bool fresh = false;
+    if(middle_.load(std::memory_order_relaxed) & kFreshBit)
+    {
+      front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+      fresh = true;
+    }
+    value = buffers_[front_];
+    return fresh;
+  }
+
+private:
+  static constexpr uint8_t kIndexMask = 0b11;
+  // set by the writer, cleared by the reader
+  static constexpr uint8_t kFreshBit = 0b100;
+
+  std::array<T, 3> buffers_;
+  uint8_t back_ = 0;
+  uint8_t front_ = 1;
+  std::atomic_uint8_t middle_ = 2;
+};
+
+}  // namespace DataTamer
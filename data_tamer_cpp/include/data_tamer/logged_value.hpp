@@ -2,9 +2,13 @@
 
 #include "data_tamer/types.hpp"
 #include "data_tamer/details/locked_reference.hpp"
+#include "data_tamer/details/triple_buffer.hpp"
 
+#include <atomic>
 #include <memory>
+#include <optional>
 #include <shared_mutex>
+#include <type_traits>
 
 namespace DataTamer
 {
@@ -80,6 +84,12 @@ public:
 
   [[nodiscard]] bool isEnabled() const { return enabled_; }
 
+  /// See LogChannel::setDeadband
+  void setDeadband(std::optional<Deadband> deadband);
+
+  /// See LogChannel::setDecimation
+  void setDecimation(size_t factor);
+
 private:
   std::weak_ptr<LogChannel> channel_;
   T value_ = {};
@@ -88,4 +98,80 @@ private:
   std::shared_mutex rw_mutex_;
 };
 
+/// true if T can be stored in a lock-free std::atomic (trivially copyable, up to 8 bytes)
+template <typename T, typename = void>
+struct IsLockFreeAtomic : std::false_type
+{
+};
+
+template <typename T>
+struct IsLockFreeAtomic<
+    T, std::enable_if_t<std::is_trivially_copyable_v<T> && sizeof(T) <= 8>>
+  : std::bool_constant<std::atomic<T>::is_always_lock_free>
+{
+};
+
+/**
+ * @brief AtomicLoggedValue is an alternative to LoggedValue, optimized for values
+ * that are updated very often by a real-time thread.
+ *
+ * set() is wait-free: it never locks a mutex and doesn't access the channel.
+ * The value is stored in a std::atomic, if it is trivially copyable and no larger
+ * than 8 bytes, or in a TripleBuffer otherwise.
+ * takeSnapshot() reads the latest published value.
+ *
+ * When the TripleBuffer is used, set() must not be called by multiple threads
+ * at the same time.
+ */
+template <typename T>
+class AtomicLoggedValue
+{
+protected:
+  AtomicLoggedValue(const std::shared_ptr<LogChannel>& channel, const std::string& name,
+                    T initial_value);
+
+  friend LogChannel;
+
+public:
+  static constexpr bool kUseAtomic = IsLockFreeAtomic<T>::value;
+
+  ~AtomicLoggedValue();
+
+  AtomicLoggedValue(AtomicLoggedValue const& other) = delete;
+  AtomicLoggedValue& operator=(AtomicLoggedValue const& other) = delete;
+
+  /**
+   * @brief set the value of the variable.
+   *
+   * @param value   new value
+   * @param auto_enable  if true and the current instance is disabled, call setEnabled(true)
+   */
+  void set(const T& value, bool auto_enable = true);
+
+  /// @brief get the stored value. Available only if kUseAtomic is true.
+  [[nodiscard]] T get() const;
+
+  /// @brief Disabling a value means that we will not record it in the snapshot
+  void setEnabled(bool enabled);
+
+  [[nodiscard]] bool isEnabled() const { return enabled_; }
+
+  /// See LogChannel::setDeadband
+  void setDeadband(std::optional<Deadband> deadband);
+
+  /// See LogChannel::setDecimation
+  void setDecimation(size_t factor);
+
+private:
+  // called by LogChannel::takeSnapshot, holding the channel mutex
+  static void copyLatest(void* self);
+
+  std::weak_ptr<LogChannel> channel_;
+  std::conditional_t<kUseAtomic, std::atomic<T>, TripleBuffer<T>> storage_;
+  // the value registered in the channel
+  T snapshot_value_ = {};
+  RegistrationID id_;
+  std::atomic_bool enabled_ = true;
+};
+
 }  // namespace DataTamer
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "data_tamer/data_sink.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+
+namespace DataTamer
+{
+
+struct FlightRecorderOptions
+{
+  /// Time window saved before the trigger
+  std::chrono::nanoseconds pre_trigger = std::chrono::seconds(30);
+  /// Time window saved after the trigger
+  std::chrono::nanoseconds post_trigger = std::chrono::seconds(5);
+  /// Maximum number of snapshots in the ring
+  size_t max_snapshots = 100'000;
+  /// Maximum memory used by the payloads of the snapshots in the ring
+  size_t max_bytes = 256 * 1024 * 1024;
+  /// if true, compress the MCAP files created by a dump
+  bool do_compression = false;
+};
+
+/**
+ * @brief The FlightRecorderSink keeps the most recent snapshots in memory
+ * (limited by time, number and size, see FlightRecorderOptions) and saves
+ * them into a MCAP file only when a trigger happens.
+ *
+ * The file contains the snapshots in the window [trigger - pre_trigger, trigger + post_trigger].
+ * It is written by a separate thread, using MCAPSink, therefore neither
+ * the producers nor the consumer thread of the sink wait for the disk.
+ *
+ * The ring and the dumps share the snapshots with the channels (no copy):
+ * they return to the pool of their channel only when removed from the ring
+ * and written to disk.
+ *
+ * The pool of a channel is sized for the queues of its sinks only, not for the ring:
+ * when the ring holds more snapshots than that, the channel drops the new ones
+ * (see LogChannel::droppedSnapshotsCount). To keep up to `max_snapshots` of a channel,
+ * use LogChannel::setSnapshotPoolSize(); each snapshot of the pool costs the size
+ * of its payload.
+ */
+class FlightRecorderSink : public DataSinkBase
+{
+public:
+  /// Predicate evaluated by the consumer thread for each new snapshot.
+  using TriggerPredicate = std::function<bool(const Snapshot&)>;
+
+  /**
+   * @param filepath_prefix  dump files created by trigger() without an explicit
+   *                         filepath are named "<filepath_prefix>_<N>.mcap"
+   * @param options          see FlightRecorderOptions
+   */
+  explicit FlightRecorderSink(std::string const& filepath_prefix,
+                              FlightRecorderOptions const& options = {});
+
+  ~FlightRecorderSink() override;
+
+  void addChannel(std::string const& channel_name, Schema const& schema) override;
+
+  bool storeSnapshot(const Snapshot& snapshot) override;
+
+  bool storeSnapshots(SnapshotsSpan snapshots) override;
+
+  /**
+   * @brief trigger requests a dump. The trigger time is the timestamp of the first
+   * snapshot processed after this call; the file is written when the post-trigger
+   * window is complete (or when the sink is destroyed).
+   *
+   * @param filepath  file to be created. If empty, a name is generated using the prefix.
+   * @return false if another trigger is still waiting for its post-trigger window.
+   */
+  bool trigger(std::string const& filepath = {});
+
+  /// Call trigger() automatically, when the predicate returns true.
+  /// The predicate is evaluated in the consumer thread and must be fast.
+  void setTriggerPredicate(TriggerPredicate predicate);
+
+  /**
+   * @brief waitForDumps blocks until all the triggered dumps are written to disk,
+   * including those that the predicate will trigger with the snapshots already pushed.
+   *
+   * @return false if the timeout expired first.
+   */
+  bool waitForDumps(std::chrono::milliseconds timeout);
+
+  /// Paths of the files written so far
+  [[nodiscard]] std::vector<std::string> dumpedFiles() const;
+
+private:
+  struct DumpRequest
+  {
+    std::string filepath;
+    std::optional<std::chrono::nanoseconds> trigger_time;
+    std::vector<SnapshotPtr> snapshots;
+  };
+
+  FlightRecorderOptions options_;
+  std::string filepath_prefix_;
+
+  // the ring is accessed only by the consumer thread
+  std::vector<SnapshotPtr> ring_;
+  size_t ring_head_ = 0;
+  size_t ring_count_ = 0;
+  size_t ring_bytes_ = 0;
+
+  // everything below is protected by mutex_
+  // schemas are identified by hash: a channel changes schema when values are registered
+  std::unordered_map<size_t, std::pair<std::string, Schema>> schemas_;
+  TriggerPredicate predicate_;
+  std::optional<DumpRequest> pending_dump_;
+  std::deque<DumpRequest> dump_queue_;
+  size_t dump_counter_ = 0;
+  size_t dumps_in_progress_ = 0;
+  std::vector<std::string> dumped_files_;
+  bool stop_ = false;
+
+  mutable std::mutex mutex_;
+  std::condition_variable dump_cv_;
+  std::condition_variable done_cv_;
+  std::thread dump_thread_;
+
+  bool requestDump(std::string const& filepath);
+  void processSnapshot(const SnapshotPtr& snapshot);
+  void pushIntoRing(const SnapshotPtr& snapshot);
+  void popFromRing();
+  void collectPendingDump(bool force);
+  void dumpLoop();
+  bool writeDump(const DumpRequest& dump,
+                 const std::unordered_map<size_t, std::pair<std::string, Schema>>& schemas);
+};
+
+}  // namespace DataTamer
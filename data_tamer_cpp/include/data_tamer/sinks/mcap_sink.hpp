@@ -2,17 +2,104 @@
 
 #include "data_tamer/data_sink.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <mutex>
+#include <thread>
 #include <unordered_map>
 
+namespace DataTamer
+{
+
 // Forward declaration
-namespace mcap
+class MCAPFileWriter;
+
+/**
+ * @brief Options of MCAPSink. They map to mcap::McapWriterOptions;
+ * see the documentation of the latter for details.
+ */
+struct MCAPSinkOptions
 {
-class McapWriter;
-}
+  enum class Compression
+  {
+    NONE,
+    LZ4,
+    ZSTD
+  };
 
-namespace DataTamer
+  enum class CompressionLevel
+  {
+    FASTEST,
+    FAST,
+    DEFAULT,
+    SLOW,
+    SLOWEST
+  };
+
+  enum class SyncPolicy
+  {
+    // data is buffered by the C library and by the operating system
+    NONE,
+    // data is passed to the operating system after each chunk.
+    // If the application crashes, only the chunks not written yet are lost.
+    FLUSH,
+    // as FLUSH, but it also waits until the data is stored on disk (fdatasync).
+    // Safe from power losses too, but much slower.
+    DATA_SYNC
+  };
+
+  Compression compression = Compression::NONE;
+  CompressionLevel compression_level = CompressionLevel::DEFAULT;
+  // compress the chunks even if they don't get smaller
+  bool force_compression = false;
+
+  // uncompressed size of a chunk. A chunk is compressed and written when it is full.
+  uint64_t chunk_size = 768 * 1024;
+  // a chunk is also closed when its first message is older than this, even if it
+  // is not full. Together with sync_policy, it limits the data lost in a crash.
+  // Without chunks, the file is synchronized with this period. 0 means no limit.
+  std::chrono::milliseconds max_chunk_age = std::chrono::milliseconds(0);
+  SyncPolicy sync_policy = SyncPolicy::NONE;
+  // write the messages directly into the data section, without chunks
+  bool no_chunking = false;
+  // number of threads compressing the full chunks in parallel, while the sink
+  // keeps writing into a new one. If 0, the chunk is compressed by the thread of the sink.
+  size_t compression_threads = 0;
+
+  bool no_chunk_crc = false;
+  bool enable_data_crc = false;
+  bool no_summary_crc = false;
+
+  bool no_message_index = false;
+  bool no_summary = false;
+  bool no_chunk_index = false;
+  bool no_statistics = false;
+  bool no_summary_offsets = false;
+  bool no_repeated_schemas = false;
+  bool no_repeated_channels = false;
+
+  /// Same as the old "do_compression" argument of MCAPSink (ZSTD with default level)
+  [[nodiscard]] static MCAPSinkOptions FromCompressionFlag(bool do_compression)
+  {
+    MCAPSinkOptions options;
+    options.compression = do_compression ? Compression::ZSTD : Compression::NONE;
+    return options;
+  }
+};
+
+/// Result of MCAPSink::recoverFile()
+struct MCAPRecoveryStats
 {
+  /// complete chunks found in the file
+  uint64_t chunks = 0;
+  /// messages found in the file
+  uint64_t messages = 0;
+  /// incomplete or corrupted data, removed from the end of the file
+  uint64_t discarded_bytes = 0;
+};
 
 /**
  * @brief The MCAPSink is an implementation of DataSinkBase that
@@ -32,23 +119,53 @@ public:
    */
   explicit MCAPSink(std::string const& filepath, bool do_compression = false);
 
+  /**
+   * @brief MCAPSink with full control of the MCAP writer.
+   * Throws if the compression is not available (see isCompressionAvailable).
+   */
+  MCAPSink(std::string const& filepath, const MCAPSinkOptions& options);
+
+  /// Some compressions may be disabled, when the MCAP library is compiled
+  [[nodiscard]] static bool isCompressionAvailable(MCAPSinkOptions::Compression compression);
+
   ~MCAPSink() override;
 
   void addChannel(std::string const& channel_name, Schema const& schema) override;
 
   bool storeSnapshot(const Snapshot& snapshot) override;
 
+  /// Write the whole batch, locking the writer only once
+  bool storeSnapshots(SnapshotsSpan snapshots) override;
+
+  /// Close the current chunk, if it is older than MCAPSinkOptions::max_chunk_age
+  void onIdle() override;
+
   /// After a certain amount of time, the MCAP file will be reset
   /// and overwritten. Default value is 600 seconds (10 minutes)
   /// To disable this feature, use a time of 0 seconds.
   /// WARNING: this can consume a large amount of disk space very quickly.
+  ///
+  /// The reset doesn't block the sink: when the limit is close, the next file is
+  /// opened in advance by a background thread, that also closes the previous one.
+  /// When overwriting, the next file is "<filepath>.next" until the previous one is closed.
   void setMaxTimeBeforeReset(std::chrono::seconds reset_time);
 
+  /// Reset the MCAP file also when it becomes larger than `max_bytes`
+  /// (see `setMaxTimeBeforeReset`). Default value is 0 (disabled).
+  void setMaxSizeBeforeReset(uint64_t max_bytes);
+
   /// When resetting the MCAP recording (see `setMaxTimeBeforeReset`),
   /// if `create_new_file` is true then the filename will be incremented
   /// and then saved instead of overwriting the previous file.
   void setCreateNewFileOnReset(bool create_new_file);
 
+  /**
+   * @brief Delete the oldest files created by the reset (see `setCreateNewFileOnReset`),
+   * to keep at most `max_files` of them and/or `max_total_bytes` on disk.
+   * The file currently recorded is not included. Use 0 for no limit (default).
+   */
+  void setRetention(size_t max_files, uint64_t max_total_bytes = 0);
+
   /// Stop recording and save the file
   void stopRecording();
 
@@ -63,10 +180,36 @@ public:
    */
   void restartRecording(std::string const& filepath, bool do_compression = false);
 
+  /// Same as above, with the MCAP writer options.
+  void restartRecording(std::string const& filepath, const MCAPSinkOptions& options);
+
+  [[nodiscard]] MCAPSinkOptions options() const;
+
+  /// Number of times the next file of the reset could not be opened.
+  /// The recording continues in the current file and the next one is requested again.
+  [[nodiscard]] uint64_t failedFileResets() const;
+
+  /**
+   * @brief recoverFile repairs an MCAP file that was not closed properly, for instance
+   * because the application crashed: the incomplete records at the end are removed
+   * and the summary (statistics and indexes) is rebuilt.
+   * The chunks are decompressed and validated in parallel.
+   *
+   * @param filepath         the file to repair.
+   * @param output_filepath  where the repaired copy is saved. If empty, the file is
+   *                         repaired in place.
+   * @param threads          number of threads reading the chunks. 0 means one per core.
+   *
+   * Throws if the file is not an MCAP file, or it can't be read or written.
+   */
+  static MCAPRecoveryStats recoverFile(std::string const& filepath,
+                                       std::string const& output_filepath = {},
+                                       size_t threads = 0);
+
 private:
   std::string filepath_;
-  bool compression_ = false;
-  std::unique_ptr<mcap::McapWriter> writer_;
+  MCAPSinkOptions options_;
+  std::unique_ptr<MCAPFileWriter> writer_;
 
   std::unordered_map<uint64_t, uint16_t> hash_to_channel_id_;
   std::unordered_map<std::string, Schema> schemas_;
@@ -77,14 +220,45 @@ private:
   size_t file_reset_counter_ = 1;
 
   std::chrono::seconds reset_time_ = std::chrono::seconds(60 * 10);
+  uint64_t reset_size_ = 0;
   std::chrono::system_clock::time_point start_time_;
 
+  size_t retention_files_ = 0;
+  uint64_t retention_bytes_ = 0;
+
   bool forced_stop_recording_ = false;
   std::recursive_mutex mutex_;
 
+  // The next file is opened, and the previous one closed, by rotation_thread_.
+  // The following variables are protected by rotation_mutex_
+  std::unique_ptr<MCAPFileWriter> next_writer_;
+  std::string next_filepath_;
+  bool next_requested_ = false;
+  // incremented to discard the files requested earlier
+  uint64_t rotation_generation_ = 0;
+  std::deque<std::function<void()>> rotation_tasks_;
+  size_t rotation_pending_ = 0;
+  bool rotation_stop_ = false;
+  std::mutex rotation_mutex_;
+  std::condition_variable rotation_cv_;
+  std::thread rotation_thread_;
+  // files closed by the rotation, oldest first. Used only by rotation_thread_
+  std::deque<std::string> rotated_files_;
+  std::atomic_uint64_t failed_file_resets_ = 0;
+
   void openFile(std::string const& filepath);
-  void restartRecordingImpl(std::string const& filepath, bool do_compression,
-                            bool new_file);
+  void writeSnapshot(const Snapshot& snapshot);
+  void checkFileReset();
+  void restartRecordingImpl(std::string const& filepath, const MCAPSinkOptions& options);
+
+  // these must be called holding rotation_mutex_
+  void requestNextFile();
+  void discardNextFile();
+  void postRotationTask(std::function<void()> task);
+
+  void rotationLoop();
+  void waitRotationTasks();
+  void applyRetention(size_t max_files, uint64_t max_bytes);
 };
 
 }  // namespace DataTamer
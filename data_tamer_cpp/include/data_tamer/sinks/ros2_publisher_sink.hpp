@@ -38,6 +38,9 @@ public:
 
   bool storeSnapshot(const Snapshot& snapshot) override;
 
+  /// Publish the schemas (if changed) only once per batch
+  bool storeSnapshots(SnapshotsSpan snapshots) override;
+
 private:
   std::unordered_map<std::string, Schema> schemas_;
   Mutex schema_mutex_;
@@ -47,6 +50,9 @@ private:
 
   bool schema_changed_ = true;
   data_tamer_msgs::msg::Snapshot data_msg_;
+
+  void publishSchemas();
+  void publishSnapshot(const Snapshot& snapshot);
 };
 
 }  // namespace DataTamer
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "data_tamer/data_sink.hpp"
+
+#include <mutex>
+#include <unordered_set>
+
+namespace DataTamer
+{
+
+/**
+ * @brief The ShmRingSink writes schemas and snapshots into a ring buffer,
+ * stored in a memory-mapped file (preferably in /dev/shm or another tmpfs).
+ *
+ * The content of the file is kept by the kernel even if the process crashes,
+ * and it can be converted into a MCAP file later, using convertToMCAP()
+ * (or the tool "dt_ring_to_mcap").
+ *
+ * The snapshots are written directly by pushSnapshot(), without going through
+ * the queue of DataSinkBase: it is just a memcpy into mapped memory, without system calls.
+ * When the ring is full, the oldest snapshots are overwritten.
+ */
+class ShmRingSink : public DataSinkBase
+{
+public:
+  /**
+   * @param filepath          file to be created (overwritten, if it exists).
+   * @param data_capacity     size in bytes of the ring containing the snapshots.
+   * @param schemas_capacity  size in bytes of the area containing the schemas.
+   */
+  explicit ShmRingSink(std::string const& filepath, size_t data_capacity = 64 * 1024 * 1024,
+                       size_t schemas_capacity = 1024 * 1024);
+
+  ~ShmRingSink() override;
+
+  /// Throws if there is no space left for a new schema.
+  void addChannel(std::string const& channel_name, Schema const& schema) override;
+
+  /// Write the snapshot into the ring immediately.
+  /// Returns false only if the snapshot is larger than the whole ring.
+  bool pushSnapshot(const SnapshotPtr& snapshot) override;
+
+  using DataSinkBase::pushSnapshot;
+
+  bool pushSnapshots(SnapshotsSpan snapshots) override;
+
+  bool storeSnapshot(const Snapshot& snapshot) override;
+
+  /**
+   * @brief convertToMCAP reads a file created by ShmRingSink, usually after the
+   * process that was writing it terminated, and saves its content as MCAP.
+   *
+   * @return the number of snapshots written into the MCAP file.
+   * Throws if the ring file is not valid.
+   */
+  static size_t convertToMCAP(std::string const& ring_filepath,
+                              std::string const& mcap_filepath);
+
+private:
+  struct Header;
+
+  Header* header_ = nullptr;
+  uint8_t* schemas_ = nullptr;
+  uint8_t* data_ = nullptr;
+  size_t mapped_size_ = 0;
+
+  std::unordered_set<size_t> known_schemas_;
+  std::mutex mutex_;
+};
+
+}  // namespace DataTamer
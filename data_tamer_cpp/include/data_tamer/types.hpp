@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 #include <memory>
 
@@ -105,6 +106,17 @@ struct RegistrationID
   void operator+=(const RegistrationID& other) { fields_count += other.fields_count; }
 };
 
+/**
+ * @brief Deadband of a numeric value: a new value is recorded only if it differs
+ * more than tolerance from the last recorded one, or if max_hold elapsed since then.
+ * The snapshots without the value mark it as not active (see Snapshot::active_mask).
+ */
+struct Deadband
+{
+  double tolerance = 0;
+  std::chrono::nanoseconds max_hold = std::chrono::seconds(1);
+};
+
 //---------------------------------------------------------
 struct TypeField
 {
@@ -3,6 +3,7 @@
 #include <functional>
 #include <cstring>
 #include <typeindex>
+#include <utility>
 
 #include "data_tamer/custom_types.hpp"
 #include "data_tamer/contrib/SerializeMe.hpp"
@@ -60,6 +61,25 @@ public:
 
   [[nodiscard]] uint16_t vectorSize() const { return array_size_; }
 
+  /// Function returning the pointer to the first element of a dynamic vector
+  /// and the number of its elements.
+  using ContiguousFunc = std::pair<const void*, size_t> (*)(const void*);
+
+  /// Pointer to the memory of the value (or the first element of an array).
+  [[nodiscard]] const void* data() const { return v_ptr_; }
+
+  /// Size of a single element, in bytes.
+  [[nodiscard]] size_t elementSize() const { return memory_size_; }
+
+  /// If the value can be serialized copying verbatim a block of memory
+  /// with constant size (numbers and arrays of numbers), return its size in bytes.
+  /// Return 0 otherwise.
+  [[nodiscard]] size_t trivialCopySize() const { return trivial_size_; }
+
+  /// Not null if the value is a dynamic vector of numbers, that can be
+  /// serialized as a size prefix followed by a single block of memory.
+  [[nodiscard]] ContiguousFunc contiguousFunc() const { return contiguous_func_; }
+
 private:
   const void* v_ptr_ = nullptr;
   BasicType type_ = BasicType::OTHER;
@@ -69,8 +89,17 @@ private:
   std::function<size_t()> get_size_impl_;
   bool is_vector_ = false;
   uint16_t array_size_ = 0;
+  size_t trivial_size_ = 0;
+  ContiguousFunc contiguous_func_ = nullptr;
 };
 
+template <typename Vector>
+inline std::pair<const void*, size_t> GetContiguousMemory(const void* ptr)
+{
+  const auto* vect = static_cast<const Vector*>(ptr);
+  return { vect->data(), vect->size() };
+}
+
 //------------------------------------------------------------
 //------------------------------------------------------------
 //------------------------------------------------------------
@@ -82,7 +111,33 @@ inline ValuePtr::ValuePtr(const T* pointer, CustomSerializer::Ptr type_info)
   , type_index_(typeid(T))
   , memory_size_(sizeof(T))
   , is_vector_(false)
+  , trivial_size_((type_info || !SERIALIZE_LITTLEENDIAN) ? 0 : sizeof(T))
 {
+  if constexpr(!has_TypeDefinition<T>() && SerializeMe::is_contiguous_container<T>())
+  {
+    // containers that opted-in SerializeMe::is_contiguous_container (Eigen-like
+    // matrices, custom buffers) are stored as a dynamic vector of their elements
+    if(!type_info)
+    {
+      using Element = SerializeMe::contiguous_value_t<T>;
+      static_assert(IsNumericType<Element>(), "Contiguous container of non-numeric type");
+      type_ = GetBasicType<Element>();
+      memory_size_ = sizeof(Element);
+      is_vector_ = true;
+      trivial_size_ = 0;
+      serialize_impl_ = [pointer](SerializeMe::SpanBytes& buffer) -> void {
+        SerializeMe::SerializeIntoBuffer(buffer, *pointer);
+      };
+      get_size_impl_ = [pointer]() -> size_t {
+        return SerializeMe::BufferSize(*pointer);
+      };
+      if constexpr(SERIALIZE_LITTLEENDIAN && !std::is_same_v<Element, bool>)
+      {
+        contiguous_func_ = &GetContiguousMemory<T>;
+      }
+      return;
+    }
+  }
   if(type_info)
   {
     serialize_impl_ = [type_info, pointer](SerializeMe::SpanBytes& buffer) -> void {
@@ -92,6 +147,14 @@ inline ValuePtr::ValuePtr(const T* pointer, CustomSerializer::Ptr type_info)
       return type_info->serializedSize(pointer);
     };
   }
+  else if constexpr(!SERIALIZE_LITTLEENDIAN && IsNumericType<T>())
+  {
+    // the bytes of the number can't be copied verbatim: convert them
+    serialize_impl_ = [pointer](SerializeMe::SpanBytes& buffer) -> void {
+      SerializeMe::SerializeIntoBuffer(buffer, *pointer);
+    };
+    get_size_impl_ = [pointer]() -> size_t { return SerializeMe::BufferSize(*pointer); };
+  }
 }
 
 template <template <class, class> class Container, class T, class... TArgs,
@@ -107,6 +170,13 @@ inline ValuePtr::ValuePtr(const Container<T, TArgs...>* vect)
     SerializeMe::SerializeIntoBuffer(buffer, *vect);
   };
   get_size_impl_ = [vect]() -> size_t { return SerializeMe::BufferSize(*vect); };
+
+  // note: std::vector<bool> is not contiguous
+  if constexpr(SERIALIZE_LITTLEENDIAN && IsNumericType<T>() && !std::is_same_v<T, bool> &&
+               SerializeMe::is_std_vector<Container<T, TArgs...>>::value)
+  {
+    contiguous_func_ = &GetContiguousMemory<Container<T, TArgs...>>;
+  }
 }
 
 template <template <class, class> class Container, class T, class... TArgs,
@@ -146,12 +216,17 @@ inline ValuePtr::ValuePtr(const Container<T, TArgs...>* vect,
 
 template <typename T, size_t N, std::enable_if_t<!has_TypeDefinition<std::array<T, N>>::value, bool>>
 inline ValuePtr::ValuePtr(const std::array<T, N>* array)
-  : v_ptr_(array)
+  : v_ptr_(array->data())
   , type_(GetBasicType<T>())
   , type_index_(typeid(std::array<T, N>))
+  , memory_size_(sizeof(T))
   , is_vector_(true)
   , array_size_(N)
 {
+  if constexpr(SERIALIZE_LITTLEENDIAN && IsNumericType<T>())
+  {
+    trivial_size_ = N * sizeof(T);
+  }
   serialize_impl_ = [array](SerializeMe::SpanBytes& buffer) -> void {
     SerializeMe::SerializeIntoBuffer(buffer, *array);
   };
@@ -160,9 +235,10 @@ inline ValuePtr::ValuePtr(const std::array<T, N>* array)
 
 template <typename T, size_t N, std::enable_if_t<!has_TypeDefinition<std::array<T, N>>::value, bool>>
 inline ValuePtr::ValuePtr(const std::array<T, N>* array, CustomSerializer::Ptr type_info)
-  : v_ptr_(array)
+  : v_ptr_(array->data())
   , type_(GetBasicType<T>())
   , type_index_(typeid(std::array<T, N>))
+  , memory_size_(sizeof(T))
   , is_vector_(true)
   , array_size_(N)
 {
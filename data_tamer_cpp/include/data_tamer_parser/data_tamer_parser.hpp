@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <cstring>
@@ -7,10 +8,13 @@
 #include <functional>
 #include <limits>
 #include <map>
+#include <memory>
 #include <optional>
 #include <sstream>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
 #include <variant>
 #include <vector>
 
@@ -42,6 +46,10 @@ enum class BasicType: uint8_t
 
 constexpr size_t TypesCount = 13;
 
+/// Serialized size of each BasicType (OTHER has no fixed size)
+constexpr std::array<size_t, TypesCount> BasicTypeSizes = { 1, 1, 1, 1, 2, 2, 4,
+                                                            4, 8, 8, 4, 8, 0 };
+
 using VarNumber = std::variant<bool, char, int8_t, uint8_t, int16_t, uint16_t, int32_t,
                                uint32_t, int64_t, uint64_t, float, double>;
 
@@ -114,11 +122,297 @@ constexpr auto NullCustomCallback = [](const std::string&, const BufferSpan,
 //
 // void(const std::string& name_field, const BufferSpan payload, const std::string& type_name)
 //
+// To parse many snapshots with the same schema, ParsePlan is much faster.
+//
 template <typename NumberCallback, typename CustomCallback = decltype(NullCustomCallback)>
 bool ParseSnapshot(const Schema& schema, SnapshotView snapshot,
                    const NumberCallback& callback_number,
                    const CustomCallback& callback_custom = NullCustomCallback);
 
+/**
+ * @brief DeltaDecoder reconstructs the complete snapshots of a channel that
+ * uses the delta encoding (see DataTamer::LogChannel::setDeltaMode).
+ * Snapshots that are not delta-encoded are passed through.
+ *
+ * Use one instance per schema and pass all its snapshots in order.
+ * Values that were never received (for instance, if the recording starts
+ * after the last keyframe) are marked as not active in the output.
+ * If the sequence number shows that some snapshots were lost, the values
+ * not included in the payload are marked as not active too, until they are
+ * received again or the next keyframe arrives.
+ */
+class DeltaDecoder
+{
+public:
+  explicit DeltaDecoder(Schema schema);
+
+  /**
+   * @param snapshot  snapshot, as stored by the sink.
+   * @param output    complete snapshot. Its buffers are owned by the decoder and are
+   *                  valid until the next call to decode().
+   * @return false if the schema doesn't match.
+   */
+  bool decode(const SnapshotView& snapshot, SnapshotView& output);
+
+  /// true if the snapshot uses the delta encoding
+  static bool IsDelta(const Schema& schema, const SnapshotView& snapshot);
+
+  /// sequence number of a snapshot created in delta mode (keyframes included)
+  static std::optional<uint32_t> Sequence(const Schema& schema,
+                                          const SnapshotView& snapshot);
+
+private:
+  Schema schema_;
+  std::optional<uint32_t> last_sequence_;
+  std::vector<std::vector<uint8_t>> values_;
+  std::vector<bool> received_;
+  std::vector<uint8_t> mask_;
+  std::vector<uint8_t> payload_;
+};
+
+/**
+ * @brief ParsePlan is a Schema compiled once, to parse many snapshots quickly.
+ *
+ * Each number that can be found in a snapshot (a "series") is identified by an
+ * integer ID; its name is built only once, and the values inside a block with a
+ * fixed size are read at precomputed offsets, without allocations or lookups.
+ *
+ * Create one plan per schema and use it for all the snapshots with that hash.
+ * The elements of dynamic vectors get their IDs when they are found the first time:
+ * for this reason parse() is not const and seriesCount() may grow.
+ *
+ * With setProjection(), parse() reads only the requested series: the blocks with a
+ * fixed size are skipped in one step, the dynamic vectors using their size.
+ */
+class ParsePlan
+{
+public:
+  explicit ParsePlan(Schema schema);
+
+  [[nodiscard]] const Schema& schema() const { return schema_; }
+
+  /// Number of series found so far
+  [[nodiscard]] size_t seriesCount() const { return leaves_.size(); }
+
+  /// Name of the series, same as the one passed to the callback of ParseSnapshot
+  [[nodiscard]] const std::string& seriesName(uint32_t series_id) const
+  {
+    return names_.at(series_id);
+  }
+
+  [[nodiscard]] BasicType seriesType(uint32_t series_id) const
+  {
+    return leaves_.at(series_id).type;
+  }
+
+  /// Linear search of a series found so far, by name
+  [[nodiscard]] std::optional<uint32_t> findSeries(const std::string& name) const;
+
+  /**
+   * @brief Parse only these series; the callback will not be invoked for the others.
+   * The names may refer to elements of dynamic vectors not found yet.
+   * Unknown names are ignored.
+   */
+  void setProjection(const std::vector<std::string>& series_names);
+
+  /// Same as above, using the series IDs
+  void setProjection(const std::vector<uint32_t>& series_ids);
+
+  /// Parse all the series again
+  void clearProjection();
+
+  /// False if the series is excluded by the projection
+  [[nodiscard]] bool isSelected(uint32_t series_id) const
+  {
+    return !projection_ || selected_.at(series_id) != 0;
+  }
+
+  /**
+   * @brief Same as ParseSnapshot, but the numbers are identified by their series ID.
+   * Callback must have signature:
+   *
+   * void(uint32_t series_id, T value)
+   *
+   * where T is any of the types in VarNumber. A generic lambda receives the value
+   * with its original type, avoiding the overhead of VarNumber.
+   *
+   * @return false if the schema doesn't match.
+   */
+  template <typename Callback>
+  bool parse(const SnapshotView& snapshot, const Callback& callback);
+
+  /// A field of the schema that always has the same size. Its series are
+  /// [first_series, first_series + series_count).
+  struct FixedField
+  {
+    uint32_t first_series = 0;
+    uint32_t series_count = 0;
+    uint32_t size = 0;
+  };
+
+  /// Empty if the field contains a dynamic vector
+  [[nodiscard]] std::optional<FixedField> fixedField(size_t field_index) const;
+
+  /// Position of the value, from the beginning of its field (only for fixed fields)
+  [[nodiscard]] uint32_t seriesOffset(uint32_t series_id) const
+  {
+    return leaves_.at(series_id).offset;
+  }
+
+  /// Same as parse(), but only a single field (active). The buffer is moved after it.
+  template <typename Callback>
+  void parseField(size_t field_index, BufferSpan& buffer, const Callback& callback)
+  {
+    run(fields_.at(field_index), buffer, callback);
+  }
+
+private:
+  struct Leaf
+  {
+    BasicType type = BasicType::OTHER;
+    // from the beginning of its Node
+    uint32_t offset = 0;
+  };
+
+  struct DynamicVector;
+
+  // Block of values with a fixed layout: the leaves [first_leaf, first_leaf + leaves_count)
+  // or, if vector is not empty, a vector with a size known only when parsing.
+  struct Node
+  {
+    uint32_t first_leaf = 0;
+    uint32_t leaves_count = 0;
+    uint32_t size = 0;
+    std::unique_ptr<DynamicVector> vector;
+    // leaves included in the projection
+    std::vector<uint32_t> selected;
+  };
+  using Program = std::vector<Node>;
+
+  struct DynamicVector
+  {
+    // the field of the vector; compileValue() creates a single element
+    TypeField field;
+    std::string name;
+    // size of an element, if it doesn't contain other dynamic vectors
+    std::optional<uint32_t> element_size;
+    // false if no element is included in the projection
+    bool selected = true;
+    // compiled when they are found
+    std::vector<Program> elements;
+  };
+
+  Schema schema_;
+  // the index is the series ID
+  std::vector<Leaf> leaves_;
+  std::vector<std::string> names_;
+  // one for each field of the schema
+  std::vector<Program> fields_;
+
+  bool projection_ = false;
+  std::unordered_set<std::string> projected_names_;
+  std::vector<uint8_t> selected_;
+
+  void compile(const TypeField& field, const std::string& name, Program& program);
+  void compileValue(const TypeField& field, const std::string& name, Program& program);
+  std::optional<uint32_t> elementSize(const TypeField& field) const;
+  bool isVectorSelected(const std::string& name) const;
+  void updateProjection(Program& program);
+
+  template <typename Callback>
+  static void emit(uint32_t series_id, BasicType type, const uint8_t* data,
+                   const Callback& callback);
+
+  template <typename Callback>
+  void run(Program& program, BufferSpan& buffer, const Callback& callback);
+};
+
+/**
+ * @brief ColumnarDecoder converts the snapshots of a schema into columns:
+ * a contiguous array for each series of the ParsePlan, with its original type,
+ * and the array of the timestamps.
+ *
+ * Each snapshot adds a row to all the columns. If a value is missing, because
+ * the field is not active or a dynamic vector is shorter, the value is zero and
+ * its bit in the validity bitmap is not set.
+ *
+ * The values of the fields with a fixed size are gathered column by column,
+ * for all the snapshots passed to the same append(); pass them in batches.
+ * Delta-encoded snapshots must be decoded first, using DeltaDecoder.
+ */
+class ColumnarDecoder
+{
+public:
+  // the values of a series (bool is stored as uint8_t)
+  using ColumnValues =
+      std::variant<std::vector<uint8_t>, std::vector<char>, std::vector<int8_t>,
+                   std::vector<int16_t>, std::vector<uint16_t>, std::vector<int32_t>,
+                   std::vector<uint32_t>, std::vector<int64_t>, std::vector<uint64_t>,
+                   std::vector<float>, std::vector<double>>;
+
+  struct Column
+  {
+    std::string name;
+    BasicType type = BasicType::OTHER;
+    ColumnValues values;
+    /// one bit for each row, same layout as SnapshotView::active_mask
+    std::vector<uint8_t> validity;
+
+    [[nodiscard]] bool isValid(size_t row) const
+    {
+      return GetBit({ validity.data(), validity.size() }, row);
+    }
+
+    /// Throws std::bad_variant_access if T is not the type of the column
+    template <typename T>
+    [[nodiscard]] const std::vector<T>& get() const
+    {
+      return std::get<std::vector<T>>(values);
+    }
+  };
+
+  explicit ColumnarDecoder(Schema schema);
+
+  /// @return false if the schema doesn't match.
+  bool append(const SnapshotView& snapshot) { return append(&snapshot, 1); }
+
+  /**
+   * @brief Add a row for each snapshot.
+   * Throws std::runtime_error if a snapshot is corrupted.
+   *
+   * @return false if the schema of any snapshot doesn't match; nothing is added.
+   */
+  bool append(const SnapshotView* snapshots, size_t count);
+
+  [[nodiscard]] size_t rows() const { return timestamps_.size(); }
+
+  [[nodiscard]] const std::vector<uint64_t>& timestamps() const { return timestamps_; }
+
+  /// The index is the series ID of plan()
+  [[nodiscard]] const std::vector<Column>& columns() const { return columns_; }
+
+  [[nodiscard]] const ParsePlan& plan() const { return plan_; }
+
+  /// Remove all the rows
+  void clear();
+
+private:
+  ParsePlan plan_;
+  std::vector<uint64_t> timestamps_;
+  std::vector<Column> columns_;
+
+  // index in fixed_fields_ of each field of the schema, or -1
+  std::vector<int> fixed_index_;
+  std::vector<ParsePlan::FixedField> fixed_fields_;
+  // used in place of inactive fields
+  std::vector<uint8_t> zeros_;
+  // beginning of each fixed field in each snapshot of the batch, and if it is active
+  std::vector<const uint8_t*> bases_;
+  std::vector<uint8_t> active_;
+
+  void addColumns();
+};
+
 //---------------------------------------------------------
 //---------------------------------------------------------
 //---------------------------------------------------------
@@ -435,4 +729,630 @@ inline bool ParseSnapshot(const Schema& schema, SnapshotView snapshot,
   return true;
 }
 
+// move the buffer after the serialized field
+inline void SkipField(const TypeField& field,
+                      const std::map<std::string, FieldsVector>& types_list,
+                      BufferSpan& buffer)
+{
+  uint32_t count = 1;
+  if(field.is_vector)
+  {
+    count = (field.array_size == 0) ? Deserialize<uint32_t>(buffer) : field.array_size;
+  }
+  if(field.type != BasicType::OTHER)
+  {
+    const size_t size = count * BasicTypeSizes[static_cast<size_t>(field.type)];
+    if(size > buffer.size)
+    {
+      throw std::runtime_error("Buffer overflow");
+    }
+    buffer.trimFront(size);
+    return;
+  }
+  const FieldsVector& fields = types_list.at(field.type_name);
+  for(uint32_t i = 0; i < count; i++)
+  {
+    for(const auto& sub_field : fields)
+    {
+      SkipField(sub_field, types_list, buffer);
+    }
+  }
+}
+
+inline DeltaDecoder::DeltaDecoder(Schema schema) : schema_(std::move(schema))
+{
+  values_.resize(schema_.fields.size());
+  received_.resize(schema_.fields.size(), false);
+}
+
+inline bool DeltaDecoder::IsDelta(const Schema& schema, const SnapshotView& snapshot)
+{
+  const size_t mask_size = (schema.fields.size() + 7) / 8;
+  return snapshot.active_mask.size == 2 * mask_size + sizeof(uint32_t);
+}
+
+inline std::optional<uint32_t> DeltaDecoder::Sequence(const Schema& schema,
+                                                      const SnapshotView& snapshot)
+{
+  const size_t mask_size = (schema.fields.size() + 7) / 8;
+  const size_t size = snapshot.active_mask.size;
+  if(size != mask_size + sizeof(uint32_t) && size != 2 * mask_size + sizeof(uint32_t))
+  {
+    return std::nullopt;
+  }
+  uint32_t sequence = 0;
+  std::memcpy(&sequence, snapshot.active_mask.data + size - sizeof(uint32_t),
+              sizeof(uint32_t));
+  return sequence;
+}
+
+inline bool DeltaDecoder::decode(const SnapshotView& snapshot, SnapshotView& output)
+{
+  if(schema_.hash != snapshot.schema_hash)
+  {
+    return false;
+  }
+  const size_t mask_size = (schema_.fields.size() + 7) / 8;
+  // in a normal snapshot, all the active fields are also in the payload
+  const BufferSpan in_payload = snapshot.active_mask;
+  BufferSpan active = snapshot.active_mask;
+  const auto sequence = Sequence(schema_, snapshot);
+  if(IsDelta(schema_, snapshot))
+  {
+    active.trimFront(mask_size);
+    if(!last_sequence_ || *sequence != uint32_t(*last_sequence_ + 1))
+    {
+      // some snapshots were lost: the values that are not in this payload
+      // may have changed in the meantime
+      std::fill(received_.begin(), received_.end(), false);
+    }
+  }
+  last_sequence_ = sequence;
+
+  // update the values that are in the payload
+  BufferSpan buffer = snapshot.payload;
+  for(size_t i = 0; i < schema_.fields.size(); i++)
+  {
+    if(GetBit(in_payload, i))
+    {
+      const uint8_t* begin = buffer.data;
+      SkipField(schema_.fields[i], schema_.custom_types, buffer);
+      values_[i].assign(begin, buffer.data);
+      received_[i] = true;
+    }
+  }
+
+  // build the complete snapshot
+  mask_.assign(mask_size, 0);
+  payload_.clear();
+  for(size_t i = 0; i < schema_.fields.size(); i++)
+  {
+    if(GetBit(active, i) && received_[i])
+    {
+      mask_[i >> 3] |= uint8_t(1 << (i % 8));
+      payload_.insert(payload_.end(), values_[i].begin(), values_[i].end());
+    }
+  }
+  output.schema_hash = snapshot.schema_hash;
+  output.timestamp = snapshot.timestamp;
+  output.active_mask = { mask_.data(), mask_.size() };
+  output.payload = { payload_.data(), payload_.size() };
+  return true;
+}
+
+inline ParsePlan::ParsePlan(Schema schema) : schema_(std::move(schema))
+{
+  fields_.resize(schema_.fields.size());
+  for(size_t i = 0; i < schema_.fields.size(); i++)
+  {
+    compile(schema_.fields[i], schema_.fields[i].field_name, fields_[i]);
+  }
+}
+
+inline void ParsePlan::compile(const TypeField& field, const std::string& name,
+                               Program& program)
+{
+  if(field.is_vector && field.array_size == 0)
+  {
+    Node node;
+    node.vector = std::make_unique<DynamicVector>();
+    node.vector->field = field;
+    node.vector->name = name;
+    node.vector->element_size = elementSize(field);
+    node.vector->selected = isVectorSelected(name);
+    program.push_back(std::move(node));
+  }
+  else if(field.is_vector)
+  {
+    for(uint32_t a = 0; a < field.array_size; a++)
+    {
+      compileValue(field, name + "[" + std::to_string(a) + "]", program);
+    }
+  }
+  else
+  {
+    compileValue(field, name, program);
+  }
+}
+
+// a single element of the field, even if it is a vector
+inline void ParsePlan::compileValue(const TypeField& field, const std::string& name,
+                                    Program& program)
+{
+  if(field.type == BasicType::OTHER)
+  {
+    for(const auto& sub_field : schema_.custom_types.at(field.type_name))
+    {
+      compile(sub_field, name + "/" + sub_field.field_name, program);
+    }
+    return;
+  }
+  // the leaves of a Node are contiguous, because a Program is compiled all at once
+  if(program.empty() || program.back().vector)
+  {
+    Node node;
+    node.first_leaf = uint32_t(leaves_.size());
+    program.push_back(std::move(node));
+  }
+  Node& node = program.back();
+  const bool selected = projection_ && projected_names_.count(name) != 0;
+  if(selected)
+  {
+    node.selected.push_back(uint32_t(leaves_.size()));
+  }
+  selected_.push_back(selected ? 1 : 0);
+  leaves_.push_back({ field.type, node.size });
+  names_.push_back(name);
+  node.leaves_count++;
+  node.size += uint32_t(BasicTypeSizes[static_cast<size_t>(field.type)]);
+}
+
+template <typename Callback>
+inline void ParsePlan::emit(uint32_t series_id, BasicType type, const uint8_t* data,
+                            const Callback& callback)
+{
+  auto load = [data](auto value) {
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+  };
+  switch(type)
+  {
+    case BasicType::BOOL:
+      callback(series_id, load(bool{}));
+      break;
+    case BasicType::CHAR:
+      callback(series_id, load(char{}));
+      break;
+    case BasicType::INT8:
+      callback(series_id, load(int8_t{}));
+      break;
+    case BasicType::UINT8:
+      callback(series_id, load(uint8_t{}));
+      break;
+    case BasicType::INT16:
+      callback(series_id, load(int16_t{}));
+      break;
+    case BasicType::UINT16:
+      callback(series_id, load(uint16_t{}));
+      break;
+    case BasicType::INT32:
+      callback(series_id, load(int32_t{}));
+      break;
+    case BasicType::UINT32:
+      callback(series_id, load(uint32_t{}));
+      break;
+    case BasicType::INT64:
+      callback(series_id, load(int64_t{}));
+      break;
+    case BasicType::UINT64:
+      callback(series_id, load(uint64_t{}));
+      break;
+    case BasicType::FLOAT32:
+      callback(series_id, load(float{}));
+      break;
+    case BasicType::FLOAT64:
+      callback(series_id, load(double{}));
+      break;
+    case BasicType::OTHER:
+      break;
+  }
+}
+
+template <typename Callback>
+inline void ParsePlan::run(Program& program, BufferSpan& buffer, const Callback& callback)
+{
+  for(auto& node : program)
+  {
+    if(!node.vector)
+    {
+      if(node.size > buffer.size)
+      {
+        throw std::runtime_error("Buffer overflow");
+      }
+      if(!projection_)
+      {
+        const uint32_t end = node.first_leaf + node.leaves_count;
+        for(uint32_t id = node.first_leaf; id < end; id++)
+        {
+          emit(id, leaves_[id].type, buffer.data + leaves_[id].offset, callback);
+        }
+      }
+      else
+      {
+        for(const uint32_t id : node.selected)
+        {
+          emit(id, leaves_[id].type, buffer.data + leaves_[id].offset, callback);
+        }
+      }
+      buffer.trimFront(node.size);
+      continue;
+    }
+
+    DynamicVector& vect = *node.vector;
+    if(!vect.selected)
+    {
+      if(!vect.element_size)
+      {
+        SkipField(vect.field, schema_.custom_types, buffer);
+        continue;
+      }
+      const uint64_t size = uint64_t(Deserialize<uint32_t>(buffer)) * *vect.element_size;
+      if(size > buffer.size)
+      {
+        throw std::runtime_error("Buffer overflow");
+      }
+      buffer.trimFront(size);
+      continue;
+    }
+    const auto count = Deserialize<uint32_t>(buffer);
+    // protect from corrupted sizes, before compiling the elements
+    if(count > buffer.size)
+    {
+      throw std::runtime_error("Buffer overflow");
+    }
+    while(vect.elements.size() < count)
+    {
+      const auto index = vect.elements.size();
+      vect.elements.emplace_back();
+      compileValue(vect.field, vect.name + "[" + std::to_string(index) + "]",
+                   vect.elements.back());
+    }
+    for(uint32_t a = 0; a < count; a++)
+    {
+      run(vect.elements[a], buffer, callback);
+    }
+  }
+}
+
+template <typename Callback>
+inline bool ParsePlan::parse(const SnapshotView& snapshot, const Callback& callback)
+{
+  if(schema_.hash != snapshot.schema_hash)
+  {
+    return false;
+  }
+  BufferSpan buffer = snapshot.payload;
+  for(size_t i = 0; i < fields_.size(); i++)
+  {
+    if(GetBit(snapshot.active_mask, i))
+    {
+      run(fields_[i], buffer, callback);
+    }
+  }
+  return true;
+}
+
+inline std::optional<ParsePlan::FixedField> ParsePlan::fixedField(size_t field_index) const
+{
+  const Program& program = fields_.at(field_index);
+  if(program.size() > 1 || (program.size() == 1 && program.front().vector))
+  {
+    return std::nullopt;
+  }
+  FixedField field;
+  if(!program.empty())
+  {
+    field.first_series = program.front().first_leaf;
+    field.series_count = program.front().leaves_count;
+    field.size = program.front().size;
+  }
+  return field;
+}
+
+inline std::optional<uint32_t> ParsePlan::elementSize(const TypeField& field) const
+{
+  if(field.type != BasicType::OTHER)
+  {
+    return uint32_t(BasicTypeSizes[static_cast<size_t>(field.type)]);
+  }
+  uint32_t size = 0;
+  for(const auto& sub_field : schema_.custom_types.at(field.type_name))
+  {
+    if(sub_field.is_vector && sub_field.array_size == 0)
+    {
+      return std::nullopt;
+    }
+    const auto sub_size = elementSize(sub_field);
+    if(!sub_size)
+    {
+      return std::nullopt;
+    }
+    size += *sub_size * (sub_field.is_vector ? sub_field.array_size : 1);
+  }
+  return size;
+}
+
+inline bool ParsePlan::isVectorSelected(const std::string& name) const
+{
+  if(!projection_)
+  {
+    return true;
+  }
+  const std::string prefix = name + "[";
+  for(const auto& projected : projected_names_)
+  {
+    if(projected.compare(0, prefix.size(), prefix) == 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+inline std::optional<uint32_t> ParsePlan::findSeries(const std::string& name) const
+{
+  for(size_t id = 0; id < names_.size(); id++)
+  {
+    if(names_[id] == name)
+    {
+      return uint32_t(id);
+    }
+  }
+  return std::nullopt;
+}
+
+inline void ParsePlan::setProjection(const std::vector<std::string>& series_names)
+{
+  projection_ = true;
+  projected_names_ = { series_names.begin(), series_names.end() };
+  for(size_t id = 0; id < names_.size(); id++)
+  {
+    selected_[id] = projected_names_.count(names_[id]) != 0 ? 1 : 0;
+  }
+  for(auto& program : fields_)
+  {
+    updateProjection(program);
+  }
+}
+
+inline void ParsePlan::setProjection(const std::vector<uint32_t>& series_ids)
+{
+  std::vector<std::string> series_names;
+  for(const auto id : series_ids)
+  {
+    series_names.push_back(names_.at(id));
+  }
+  setProjection(series_names);
+}
+
+inline void ParsePlan::clearProjection()
+{
+  projection_ = false;
+  projected_names_.clear();
+  std::fill(selected_.begin(), selected_.end(), 0);
+  for(auto& program : fields_)
+  {
+    updateProjection(program);
+  }
+}
+
+inline void ParsePlan::updateProjection(Program& program)
+{
+  for(auto& node : program)
+  {
+    if(!node.vector)
+    {
+      node.selected.clear();
+      for(uint32_t id = node.first_leaf; id < node.first_leaf + node.leaves_count; id++)
+      {
+        if(selected_[id])
+        {
+          node.selected.push_back(id);
+        }
+      }
+      continue;
+    }
+    node.vector->selected = isVectorSelected(node.vector->name);
+    for(auto& element : node.vector->elements)
+    {
+      updateProjection(element);
+    }
+  }
+}
+
+inline ColumnarDecoder::ColumnarDecoder(Schema schema) : plan_(std::move(schema))
+{
+  const size_t fields_count = plan_.schema().fields.size();
+  size_t max_size = 0;
+  for(size_t i = 0; i < fields_count; i++)
+  {
+    if(auto fixed = plan_.fixedField(i))
+    {
+      fixed_index_.push_back(int(fixed_fields_.size()));
+      fixed_fields_.push_back(*fixed);
+      max_size = std::max<size_t>(max_size, fixed->size);
+    }
+    else
+    {
+      fixed_index_.push_back(-1);
+    }
+  }
+  zeros_.resize(max_size, 0);
+  addColumns();
+}
+
+inline void ColumnarDecoder::addColumns()
+{
+  while(columns_.size() < plan_.seriesCount())
+  {
+    const auto id = uint32_t(columns_.size());
+    Column column;
+    column.name = plan_.seriesName(id);
+    column.type = plan_.seriesType(id);
+    switch(column.type)
+    {
+      case BasicType::BOOL:
+      case BasicType::UINT8:
+        column.values = std::vector<uint8_t>();
+        break;
+      case BasicType::CHAR:
+        column.values = std::vector<char>();
+        break;
+      case BasicType::INT8:
+        column.values = std::vector<int8_t>();
+        break;
+      case BasicType::INT16:
+        column.values = std::vector<int16_t>();
+        break;
+      case BasicType::UINT16:
+        column.values = std::vector<uint16_t>();
+        break;
+      case BasicType::INT32:
+        column.values = std::vector<int32_t>();
+        break;
+      case BasicType::UINT32:
+        column.values = std::vector<uint32_t>();
+        break;
+      case BasicType::INT64:
+        column.values = std::vector<int64_t>();
+        break;
+      case BasicType::UINT64:
+        column.values = std::vector<uint64_t>();
+        break;
+      case BasicType::FLOAT32:
+        column.values = std::vector<float>();
+        break;
+      case BasicType::FLOAT64:
+      case BasicType::OTHER:
+        column.values = std::vector<double>();
+        break;
+    }
+    // missing in the previous rows
+    std::visit([this](auto& values) { values.resize(rows(), 0); }, column.values);
+    column.validity.resize((rows() + 7) / 8, 0);
+    columns_.push_back(std::move(column));
+  }
+}
+
+inline bool ColumnarDecoder::append(const SnapshotView* snapshots, size_t count)
+{
+  for(size_t r = 0; r < count; r++)
+  {
+    if(snapshots[r].schema_hash != plan_.schema().hash)
+    {
+      return false;
+    }
+  }
+  const size_t first_row = rows();
+  for(size_t r = 0; r < count; r++)
+  {
+    timestamps_.push_back(snapshots[r].timestamp);
+  }
+  for(auto& column : columns_)
+  {
+    std::visit([this](auto& values) { values.resize(rows(), 0); }, column.values);
+    column.validity.resize((rows() + 7) / 8, 0);
+  }
+
+  auto set_valid = [](Column& column, size_t row) {
+    column.validity[row >> 3] |= uint8_t(1 << (row % 8));
+  };
+
+  // first pass, row by row: find the fixed fields and decode the others
+  bases_.resize(fixed_fields_.size() * count);
+  active_.resize(fixed_fields_.size() * count);
+  for(size_t r = 0; r < count; r++)
+  {
+    const size_t row = first_row + r;
+    BufferSpan buffer = snapshots[r].payload;
+    for(size_t i = 0; i < fixed_index_.size(); i++)
+    {
+      const bool active = GetBit(snapshots[r].active_mask, i);
+      if(fixed_index_[i] < 0)
+      {
+        if(active)
+        {
+          plan_.parseField(i, buffer, [&](uint32_t series_id, auto value) {
+            if(series_id >= columns_.size())
+            {
+              // new element of a dynamic vector
+              addColumns();
+            }
+            using T = std::conditional_t<std::is_same_v<decltype(value), bool>, uint8_t,
+                                         decltype(value)>;
+            auto& column = columns_[series_id];
+            std::get<std::vector<T>>(column.values)[row] = T(value);
+            set_valid(column, row);
+          });
+        }
+        continue;
+      }
+      const size_t k = size_t(fixed_index_[i]) * count + r;
+      const auto& field = fixed_fields_[size_t(fixed_index_[i])];
+      active_[k] = active ? 1 : 0;
+      bases_[k] = zeros_.data();
+      if(active)
+      {
+        if(field.size > buffer.size)
+        {
+          throw std::runtime_error("Buffer overflow");
+        }
+        bases_[k] = buffer.data;
+        buffer.trimFront(field.size);
+      }
+    }
+  }
+
+  // second pass, column by column: gather the values of the fixed fields
+  for(size_t f = 0; f < fixed_fields_.size(); f++)
+  {
+    const auto& field = fixed_fields_[f];
+    const uint8_t* const* bases = bases_.data() + f * count;
+    const uint8_t* active = active_.data() + f * count;
+    for(uint32_t id = field.first_series; id < field.first_series + field.series_count; id++)
+    {
+      auto& column = columns_[id];
+      const uint32_t offset = plan_.seriesOffset(id);
+      std::visit(
+          [&](auto& values) {
+            using T = typename std::decay_t<decltype(values)>::value_type;
+            T* out = values.data() + first_row;
+            for(size_t r = 0; r < count; r++)
+            {
+              std::memcpy(&out[r], bases[r] + offset, sizeof(T));
+            }
+          },
+          column.values);
+      for(size_t r = 0; r < count; r++)
+      {
+        if(active[r])
+        {
+          set_valid(column, first_row + r);
+        }
+      }
+    }
+  }
+  return true;
+}
+
+inline void ColumnarDecoder::clear()
+{
+  timestamps_.clear();
+  for(auto& column : columns_)
+  {
+    std::visit([](auto& values) { values.clear(); }, column.values);
+    column.validity.clear();
+  }
+}
+
 }  // namespace DataTamerParser
@@ -2,12 +2,250 @@
 #include "data_tamer/data_sink.hpp"
 #include "data_tamer/contrib/SerializeMe.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 
 namespace DataTamer
 {
 
+/**
+ * Bounded multi-producer / multi-consumer queue, lock-free
+ * (see Dmitry Vyukov, "Bounded MPMC queue").
+ * The capacity is rounded up to a power of two.
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+  explicit BoundedQueue(size_t capacity)
+  {
+    size_t size = 1;
+    while(size < capacity)
+    {
+      size *= 2;
+    }
+    cells_ = std::make_unique<Cell[]>(size);
+    mask_ = size - 1;
+    for(size_t i = 0; i < size; i++)
+    {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  /// return false if the queue is full
+  bool push(T value)
+  {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell* cell = nullptr;
+    while(true)
+    {
+      cell = &cells_[pos & mask_];
+      const size_t seq = cell->sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if(diff == 0)
+      {
+        if(enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          break;
+        }
+      }
+      else if(diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::move(value);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// return false if the queue is empty
+  bool pop(T& value)
+  {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    Cell* cell = nullptr;
+    while(true)
+    {
+      cell = &cells_[pos & mask_];
+      const size_t seq = cell->sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if(diff == 0)
+      {
+        if(dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          break;
+        }
+      }
+      else if(diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    value = std::move(cell->value);
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  struct Cell
+  {
+    std::atomic_size_t sequence = 0;
+    T value = {};
+  };
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_ = 0;
+  alignas(64) std::atomic_size_t enqueue_pos_ = 0;
+  alignas(64) std::atomic_size_t dequeue_pos_ = 0;
+};
+
+/**
+ * Snapshots are shared with the sinks using std::shared_ptr.
+ * Each snapshot lives in a Slot, together with the memory of the control block
+ * of its shared_ptr: when the last sink releases the snapshot, the deallocation
+ * of the control block returns the Slot to a lock-free free-list.
+ * Therefore acquire() neither allocates (once the pool is warm) nor locks.
+ * Thread-safe: multiple threads can take a snapshot of the same channel at the same time.
+ */
+class SnapshotPool
+{
+public:
+  /// return an empty pointer if all the snapshots are still in use
+  std::shared_ptr<Snapshot> acquire()
+  {
+    Slot* slot = nullptr;
+    if(!state_->free_slots.pop(slot))
+    {
+      size_t count = state_->allocated.load(std::memory_order_relaxed);
+      do
+      {
+        if(count >= state_->capacity)
+        {
+          return {};
+        }
+      } while(!state_->allocated.compare_exchange_weak(count, count + 1,
+                                                        std::memory_order_relaxed));
+      slot = new Slot();
+    }
+    return std::shared_ptr<Snapshot>(&slot->snapshot, KeepInSlot{},
+                                     SlotAllocator<Snapshot>(state_, slot));
+  }
+
+  /// Must not be called concurrently with acquire()
+  void setCapacity(size_t capacity)
+  {
+    if(capacity != state_->capacity)
+    {
+      // snapshots still used by the sinks return to the previous free-list,
+      // that is deleted when the last one is released
+      state_ = std::make_shared<State>(capacity);
+    }
+  }
+
+private:
+  static constexpr size_t kControlBlockSize = 64;
+
+  struct Slot
+  {
+    Snapshot snapshot;
+    alignas(std::max_align_t) unsigned char control_block[kControlBlockSize];
+  };
+
+  struct State
+  {
+    explicit State(size_t max_slots)
+      : capacity(max_slots), free_slots(std::max<size_t>(max_slots, 1))
+    {}
+    ~State()
+    {
+      Slot* slot = nullptr;
+      while(free_slots.pop(slot))
+      {
+        delete slot;
+      }
+    }
+    const size_t capacity;
+    std::atomic_size_t allocated = 0;
+    BoundedQueue<Slot*> free_slots;
+  };
+
+  // the Snapshot is destroyed with its Slot, not when released
+  struct KeepInSlot
+  {
+    void operator()(Snapshot*) const {}
+  };
+
+  // Allocator of the control block of the shared_ptr. It uses the memory of the
+  // Slot and returns the Slot to the free-list, once deallocated.
+  template <typename T>
+  struct SlotAllocator
+  {
+    using value_type = T;
+
+    SlotAllocator(std::shared_ptr<State> state, Slot* slot)
+      : state(std::move(state)), slot(slot)
+    {}
+    template <typename U>
+    SlotAllocator(const SlotAllocator<U>& other) : state(other.state), slot(other.slot)
+    {}
+
+    T* allocate(size_t n)
+    {
+      static_assert(sizeof(T) <= kControlBlockSize, "increase kControlBlockSize");
+      static_assert(alignof(T) <= alignof(std::max_align_t));
+      if(n != 1)
+      {
+        throw std::bad_alloc();
+      }
+      return reinterpret_cast<T*>(slot->control_block);
+    }
+
+    void deallocate(T*, size_t)
+    {
+      // synchronize with the thread that will acquire it, using the free-list
+      if(!state->free_slots.push(slot))
+      {
+        state->allocated--;
+        delete slot;
+      }
+    }
+
+    template <typename U>
+    bool operator==(const SlotAllocator<U>& other) const
+    {
+      return slot == other.slot;
+    }
+    template <typename U>
+    bool operator!=(const SlotAllocator<U>& other) const
+    {
+      return slot != other.slot;
+    }
+
+    std::shared_ptr<State> state;
+    Slot* slot = nullptr;
+  };
+
+  std::shared_ptr<State> state_ =
+      std::make_shared<State>(LogChannel::kDefaultSnapshotPoolSize);
+};
+
 struct LogChannel::Pimpl
 {
   struct ValueHolder
@@ -16,6 +254,41 @@ struct LogChannel::Pimpl
     bool enabled = true;
     bool registered = true;
     ValuePtr holder;
+
+    struct DeadbandState
+    {
+      Deadband deadband;
+      bool recorded = false;
+      double last_value = 0;
+      std::chrono::nanoseconds last_time = {};
+    };
+    std::optional<DeadbandState> deadband;
+    // recorded once every [decimation] snapshots
+    size_t decimation = 1;
+  };
+
+  // A single step of the serialization plan. It contains only the information
+  // needed by takeSnapshot; names and types are kept in ValueHolder.
+  struct SerializeOp
+  {
+    enum Kind : uint8_t
+    {
+      COPY,    // memcpy of [size] bytes
+      VECTOR,  // size prefix, followed by a memcpy of the elements
+      CUSTOM   // fallback to ValuePtr::serialize
+    };
+    Kind kind = COPY;
+    const void* src = nullptr;
+    // bytes to copy (COPY) or size of a single element (VECTOR)
+    size_t size = 0;
+    ValuePtr::ContiguousFunc contiguous = nullptr;
+    const ValuePtr* holder = nullptr;
+    size_t field_index = 0;
+    // used only in delta mode
+    size_t previous_offset = 0;
+    // COPY of a single value with a deadband
+    ValueHolder::DeadbandState* deadband = nullptr;
+    size_t decimation = 1;
   };
 
   std::string channel_name;
@@ -25,15 +298,299 @@ struct LogChannel::Pimpl
   std::vector<ValueHolder> series;
   std::unordered_map<std::string, size_t> registered_values;
 
+  // set to true when the active mask and the serialization plan must be rebuilt
   bool mask_dirty = true;
 
-  Snapshot snapshot;
+  std::vector<SerializeOp> plan;
+  // payload size of the COPY operations, known when the plan is compiled
+  size_t plan_fixed_size = 0;
+  bool plan_has_dynamic = false;
+  // true if serialize() modifies the state of deadband or delta encoding
+  bool plan_stateful = false;
+
+  void compilePlan();
+
+  // Prepare the plan if needed, acquire a snapshot from the pool and serialize the values.
+  // Return an empty pointer if the snapshot was dropped.
+  std::shared_ptr<Snapshot> createSnapshot(std::chrono::nanoseconds timestamp);
+
+  // true if createSnapshot() modifies only thread-safe members and can be called
+  // by multiple threads, holding the mutex in shared mode
+  bool concurrentSnapshotAllowed() const;
+
+  // Serialize the registered values into the snapshot, executing the plan.
+  // Return false if the size of a vector changed during the copy.
+  bool serialize(Snapshot& snapshot, uint64_t counter, bool delta_snapshot);
+
+  // delta mode: see LogChannel::setDeltaMode
+  bool delta_mode = false;
+  size_t keyframe_interval = 0;
+  size_t snapshots_since_keyframe = 0;
+  bool force_keyframe = true;
+  // latest values of the fixed-size fields, as serialized in the payload
+  std::vector<uint8_t> previous_values;
+
+  ActiveMask active_mask;
+  // for each decimation factor, the fields using it
+  std::map<size_t, ActiveMask> decimation_masks;
+  std::atomic_uint64_t snapshot_counter = 0;
+
+  // seqlock mode: see LogChannel::setSeqLockMode
+  std::atomic_bool seqlock_mode = false;
+  SeqLock seqlock;
+  static constexpr int kMaxSeqLockRetries = 64;
+  std::atomic_uint64_t torn_snapshots = 0;
+  // a failed attempt must not modify the state of deadband and delta encoding
+  std::vector<uint8_t> previous_values_backup;
+  std::vector<ValueHolder::DeadbandState> deadband_backup;
+  void saveFiltersState();
+  void restoreFiltersState();
+
+  SnapshotPool pool;
+  // false until setSnapshotPoolSize() is called
+  bool pool_size_explicit = false;
+  std::atomic_uint64_t pool_drops = 0;
+  // the default size of the pool depends on the sinks
+  void updatePoolCapacity();
   Schema schema;
   bool logging_started = false;
 
   std::unordered_set<std::shared_ptr<DataSinkBase>> sinks;
+
+  std::vector<std::pair<SnapshotHook, void*>> snapshot_hooks;
+
+  ClockBase::Ptr clock = std::make_shared<SystemClock>();
 };
 
+void LogChannel::Pimpl::compilePlan()
+{
+  plan.clear();
+  plan_fixed_size = 0;
+  plan_has_dynamic = false;
+  plan_stateful = delta_mode;
+
+  for(size_t index = 0; index < series.size(); index++)
+  {
+    auto& instance = series[index];
+    if(!instance.enabled)
+    {
+      continue;
+    }
+    const ValuePtr& holder = instance.holder;
+    SerializeOp op;
+    op.src = holder.data();
+    op.field_index = index;
+    op.decimation = instance.decimation;
+
+    if(const size_t size = holder.trivialCopySize(); size > 0)
+    {
+      op.previous_offset = plan_fixed_size;
+      plan_fixed_size += size;
+      if(instance.deadband)
+      {
+        op.holder = &holder;
+        op.deadband = &(*instance.deadband);
+        plan_stateful = true;
+      }
+      // values that are adjacent in memory are copied at once, unless
+      // each of them must be compared with its previous value
+      if(!delta_mode && !op.deadband && op.decimation == 1 && !plan.empty() &&
+         plan.back().kind == SerializeOp::COPY && !plan.back().deadband &&
+         plan.back().decimation == 1 &&
+         static_cast<const uint8_t*>(plan.back().src) + plan.back().size == op.src)
+      {
+        plan.back().size += size;
+        continue;
+      }
+      op.kind = SerializeOp::COPY;
+      op.size = size;
+    }
+    else if(auto func = holder.contiguousFunc())
+    {
+      op.kind = SerializeOp::VECTOR;
+      op.size = holder.elementSize();
+      op.contiguous = func;
+      plan_has_dynamic = true;
+    }
+    else
+    {
+      op.kind = SerializeOp::CUSTOM;
+      op.holder = &holder;
+      plan_has_dynamic = true;
+    }
+    plan.push_back(op);
+  }
+
+  if(delta_mode)
+  {
+    // the previous values refer to a different plan
+    previous_values.resize(plan_fixed_size);
+    force_keyframe = true;
+  }
+}
+
+bool LogChannel::Pimpl::serialize(Snapshot& snapshot, uint64_t counter,
+                                  bool delta_snapshot)
+{
+  // only the size of dynamic values must be computed at each snapshot
+  size_t payload_size = plan_fixed_size;
+  if(plan_has_dynamic)
+  {
+    for(auto const& op : plan)
+    {
+      if(op.kind == SerializeOp::VECTOR)
+      {
+        payload_size += sizeof(uint32_t) + op.contiguous(op.src).second * op.size;
+      }
+      else if(op.kind == SerializeOp::CUSTOM)
+      {
+        payload_size += op.holder->getSerializedSize();
+      }
+    }
+  }
+  snapshot.active_mask = active_mask;
+  snapshot.payload.resize(payload_size);
+
+  // remove the decimated fields, one group at a time
+  for(auto const& [factor, decimation_mask] : decimation_masks)
+  {
+    if(counter % factor != 0)
+    {
+      ClearBits(snapshot.active_mask, decimation_mask);
+    }
+  }
+
+  // in a delta snapshot, the mask is followed by a copy of itself. The bits of the
+  // first copy are cleared for the fixed-size values that didn't change.
+  // In delta mode, all the snapshots end with their sequence number, to detect gaps.
+  if(delta_mode)
+  {
+    const size_t mask_size = snapshot.active_mask.size();
+    const size_t copies = delta_snapshot ? 2 : 1;
+    snapshot.active_mask.resize(mask_size * copies + sizeof(uint32_t));
+    if(delta_snapshot)
+    {
+      std::copy_n(snapshot.active_mask.begin(), mask_size,
+                  snapshot.active_mask.begin() + long(mask_size));
+    }
+    const auto sequence = static_cast<uint32_t>(counter);
+    std::memcpy(snapshot.active_mask.data() + mask_size * copies, &sequence,
+                sizeof(uint32_t));
+  }
+
+  // serialize data into snapshot.payload, executing the plan
+  uint8_t* dst = snapshot.payload.data();
+  uint8_t* const dst_end = dst + payload_size;
+
+  for(auto const& op : plan)
+  {
+    if(op.decimation > 1 && counter % op.decimation != 0)
+    {
+      continue;
+    }
+    switch(op.kind)
+    {
+      case SerializeOp::COPY: {
+        if(op.deadband)
+        {
+          auto& state = *op.deadband;
+          const double value =
+              std::visit([](auto var) { return double(var); },
+                         DeserializeAsVarType(op.holder->type(), op.src));
+          if(state.recorded &&
+             std::abs(value - state.last_value) <= state.deadband.tolerance &&
+             snapshot.timestamp - state.last_time < state.deadband.max_hold)
+          {
+            // inactive, in keyframes and delta snapshots: also in the second copy
+            // of the mask, or the decoder would hold the previous value
+            SetBit(snapshot.active_mask, op.field_index, false);
+            if(delta_snapshot)
+            {
+              const size_t active_copy = active_mask.size() * 8;
+              SetBit(snapshot.active_mask, active_copy + op.field_index, false);
+            }
+            break;
+          }
+          state.recorded = true;
+          state.last_value = value;
+          state.last_time = snapshot.timestamp;
+        }
+        std::memcpy(dst, op.src, op.size);
+        if(delta_mode)
+        {
+          uint8_t* previous = previous_values.data() + op.previous_offset;
+          if(delta_snapshot && std::memcmp(dst, previous, op.size) == 0)
+          {
+            // unchanged: remove it from the payload
+            SetBit(snapshot.active_mask, op.field_index, false);
+            break;
+          }
+          std::memcpy(previous, dst, op.size);
+        }
+        dst += op.size;
+      }
+      break;
+      case SerializeOp::VECTOR: {
+        const auto [data, count] = op.contiguous(op.src);
+        if(count * op.size + sizeof(uint32_t) > size_t(dst_end - dst))
+        {
+          // the vector was resized after the payload size was computed
+          return false;
+        }
+        const auto num_values = static_cast<uint32_t>(count);
+        std::memcpy(dst, &num_values, sizeof(uint32_t));
+        dst += sizeof(uint32_t);
+        if(count > 0)
+        {
+          std::memcpy(dst, data, count * op.size);
+          dst += count * op.size;
+        }
+      }
+      break;
+      case SerializeOp::CUSTOM: {
+        SerializeMe::SpanBytes buffer(dst, size_t(dst_end - dst));
+        op.holder->serialize(buffer);
+        dst = buffer.data();
+      }
+      break;
+    }
+  }
+  snapshot.payload.resize(size_t(dst - snapshot.payload.data()));
+  return true;
+}
+
+void LogChannel::Pimpl::saveFiltersState()
+{
+  if(delta_mode)
+  {
+    previous_values_backup = previous_values;
+  }
+  deadband_backup.clear();
+  for(auto const& op : plan)
+  {
+    if(op.deadband)
+    {
+      deadband_backup.push_back(*op.deadband);
+    }
+  }
+}
+
+void LogChannel::Pimpl::restoreFiltersState()
+{
+  if(delta_mode)
+  {
+    previous_values.swap(previous_values_backup);
+  }
+  size_t index = 0;
+  for(auto const& op : plan)
+  {
+    if(op.deadband)
+    {
+      *op.deadband = deadband_backup[index++];
+    }
+  }
+}
+
 RegistrationID LogChannel::registerValueImpl(const std::string& name,
                                              ValuePtr&& value_ptr,
                                              CustomSerializer::Ptr type_info)
@@ -156,11 +713,48 @@ void LogChannel::unregister(const RegistrationID& id)
     instance.registered = false;
     instance.enabled = false;
   }
+  // the plan may contain a pointer to the unregistered value
+  _p->mask_dirty = true;
+}
+
+void LogChannel::setDeadband(const RegistrationID& id, std::optional<Deadband> deadband)
+{
+  std::lock_guard const lock(_p->mutex);
+  for(size_t i = 0; i < id.fields_count; i++)
+  {
+    auto& instance = _p->series[id.first_index + i];
+    if(instance.holder.type() == BasicType::OTHER || instance.holder.isVector())
+    {
+      throw std::runtime_error("A deadband can be used only with numeric values");
+    }
+  }
+  for(size_t i = 0; i < id.fields_count; i++)
+  {
+    auto& instance = _p->series[id.first_index + i];
+    instance.deadband.reset();
+    if(deadband)
+    {
+      instance.deadband = Pimpl::ValueHolder::DeadbandState{ *deadband };
+    }
+  }
+  _p->mask_dirty = true;
+}
+
+void LogChannel::setDecimation(const RegistrationID& id, size_t factor)
+{
+  std::lock_guard const lock(_p->mutex);
+  for(size_t i = 0; i < id.fields_count; i++)
+  {
+    _p->series[id.first_index + i].decimation = std::max<size_t>(factor, 1);
+  }
+  _p->mask_dirty = true;
 }
 
 void LogChannel::addDataSink(std::shared_ptr<DataSinkBase> sink)
 {
+  std::lock_guard const lock(_p->mutex);
   _p->sinks.insert(sink);
+  _p->updatePoolCapacity();
 }
 
 Schema LogChannel::getSchema() const
@@ -169,6 +763,71 @@ Schema LogChannel::getSchema() const
   return _p->schema;
 }
 
+void LogChannel::setDeltaMode(bool enable, size_t keyframe_interval)
+{
+  std::lock_guard const lock(_p->mutex);
+  _p->delta_mode = enable;
+  _p->keyframe_interval = keyframe_interval;
+  _p->mask_dirty = true;
+}
+
+void LogChannel::setSnapshotPoolSize(size_t max_snapshots)
+{
+  std::lock_guard const lock(_p->mutex);
+  _p->pool_size_explicit = true;
+  _p->pool.setCapacity(max_snapshots);
+}
+
+uint64_t LogChannel::droppedSnapshotsCount() const
+{
+  return _p->pool_drops;
+}
+
+void LogChannel::Pimpl::updatePoolCapacity()
+{
+  if(pool_size_explicit)
+  {
+    return;
+  }
+  size_t pending = 0;
+  for(auto const& sink : sinks)
+  {
+    pending += sink->maxPendingSnapshots();
+  }
+  pool.setCapacity(std::max(pending, kDefaultSnapshotPoolSize));
+}
+
+void LogChannel::setSeqLockMode(bool enable)
+{
+  std::lock_guard const lock(_p->mutex);
+  _p->seqlock_mode = enable;
+}
+
+SeqLock* LogChannel::seqLock()
+{
+  return _p->seqlock_mode.load(std::memory_order_relaxed) ? &_p->seqlock : nullptr;
+}
+
+uint64_t LogChannel::tornSnapshotsCount() const
+{
+  return _p->torn_snapshots;
+}
+
+void LogChannel::addSnapshotHook(SnapshotHook hook, void* context)
+{
+  std::lock_guard const lock(_p->mutex);
+  _p->snapshot_hooks.emplace_back(hook, context);
+}
+
+void LogChannel::removeSnapshotHook(void* context)
+{
+  std::lock_guard const lock(_p->mutex);
+  auto& hooks = _p->snapshot_hooks;
+  hooks.erase(std::remove_if(hooks.begin(), hooks.end(),
+                             [context](const auto& hook) { return hook.second == context; }),
+              hooks.end());
+}
+
 Mutex& LogChannel::writeMutex()
 {
   return _p->mutex;
@@ -180,72 +839,194 @@ void LogChannel::addCustomType(const std::string& custom_type_name,
   _p->schema.custom_types[custom_type_name] = fields;
 }
 
-bool LogChannel::takeSnapshot(std::chrono::nanoseconds timestamp)
+std::shared_ptr<Snapshot> LogChannel::Pimpl::createSnapshot(std::chrono::nanoseconds timestamp)
 {
+  // update the active_mask and the serialization plan if necessary
+  if(mask_dirty)
   {
-    std::lock_guard const lock(_p->mutex);
-
-    if(_p->sinks.empty())
+    mask_dirty = false;
+    auto& mask = active_mask;
+    mask.clear();
+    const auto vect_size = (series.size() + 7) / 8;  // ceiling size
+    mask.resize(vect_size, 0xFF);
+    decimation_masks.clear();
+    for(size_t i = 0; i < series.size(); i++)
     {
-      return false;
-    }
-    // update the _p->snapshot.active_mask if necessary
-    if(_p->mask_dirty)
-    {
-      _p->mask_dirty = false;
-      auto& mask = _p->snapshot.active_mask;
-      mask.clear();
-      const auto vect_size = (_p->series.size() + 7) / 8;  // ceiling size
-      mask.resize(vect_size, 0xFF);
-      for(size_t i = 0; i < _p->series.size(); i++)
+      auto const& instance = series[i];
+      if(!instance.enabled)
       {
-        auto const& instance = _p->series[i];
-        if(!instance.enabled)
-        {
-          SetBit(mask, i, false);
-        }
+        SetBit(mask, i, false);
+      }
+      else if(instance.decimation > 1)
+      {
+        auto& decimation_mask = decimation_masks[instance.decimation];
+        decimation_mask.resize(vect_size, 0);
+        SetBit(decimation_mask, i, true);
       }
     }
+    compilePlan();
+  }
+
+  // call sink->addChannel (usually done once)
+  if(!logging_started)
+  {
+    logging_started = true;
+    for(auto const& sink : sinks)
+    {
+      sink->addChannel(channel_name, schema);
+    }
+    // the capacity of the queues may have changed after addDataSink()
+    updatePoolCapacity();
+  }
+
+  auto snapshot = pool.acquire();
+  if(!snapshot)
+  {
+    // the sinks are not consuming the snapshots fast enough
+    pool_drops++;
+    return {};
+  }
+  snapshot->schema_hash = schema.hash;
+  snapshot->timestamp = timestamp;
+  snapshot->channel_name = channel_name;
 
-    size_t payload_size = 0;
-    for(size_t i = 0; i < _p->series.size(); i++)
+  const uint64_t counter = snapshot_counter.fetch_add(1, std::memory_order_relaxed);
+
+  for(auto const& [hook, context] : snapshot_hooks)
+  {
+    hook(context);
+  }
+
+  bool delta_snapshot = false;
+  if(delta_mode)
+  {
+    if(force_keyframe || snapshots_since_keyframe + 1 >= keyframe_interval)
     {
-      auto const& instance = _p->series[i];
-      payload_size += instance.holder.getSerializedSize();
+      force_keyframe = false;
+      snapshots_since_keyframe = 0;
     }
-    _p->snapshot.payload.resize(payload_size);
+    else
+    {
+      delta_snapshot = true;
+      snapshots_since_keyframe++;
+    }
+  }
 
-    // call sink->addChannel (usually done once)
-    if(!_p->logging_started)
+  if(!seqlock_mode)
+  {
+    if(!serialize(*snapshot, counter, delta_snapshot))
     {
-      _p->logging_started = true;
-      _p->snapshot.schema_hash = _p->schema.hash;
-      for(auto const& sink : _p->sinks)
+      // the previous values may be partially updated. Written only in delta mode,
+      // where concurrent snapshots are not allowed
+      if(delta_mode)
       {
-        sink->addChannel(_p->channel_name, _p->schema);
+        force_keyframe = true;
       }
+      return {};
     }
-
-    _p->snapshot.timestamp = timestamp;
-    _p->snapshot.channel_name = channelName();
-
-    // serialize data into _p->snapshot.payload
-    SerializeMe::SpanBytes payload_buffer(_p->snapshot.payload);
-
-    for(auto const& entry : _p->series)
+  }
+  else
+  {
+    // optimistic copy: if a writer was active, restore the state of the
+    // filters (deadband and delta) and try again
+    bool success = false;
+    for(int attempt = 0; attempt < kMaxSeqLockRetries && !success; attempt++)
+    {
+      uint64_t token = 0;
+      if(!seqlock.readBegin(token))
+      {
+        std::this_thread::yield();
+        continue;
+      }
+      if(plan_stateful)
+      {
+        saveFiltersState();
+      }
+      success = serialize(*snapshot, counter, delta_snapshot) &&
+                seqlock.readValidate(token);
+      if(!success && plan_stateful)
+      {
+        restoreFiltersState();
+      }
+      if(!success)
+      {
+        std::this_thread::yield();
+      }
+    }
+    if(!success)
     {
-      if(entry.enabled)
+      torn_snapshots++;
+      // the decoders will see a gap in the sequence: help them to recover
+      if(delta_mode)
       {
-        entry.holder.serialize(payload_buffer);
+        force_keyframe = true;
       }
+      return {};
     }
-    _p->snapshot.payload.resize(_p->snapshot.payload.size() - payload_buffer.size());
   }
+  return snapshot;
+}
+
+bool LogChannel::Pimpl::concurrentSnapshotAllowed() const
+{
+  return !mask_dirty && logging_started && !plan_stateful && snapshot_hooks.empty();
+}
+
+SnapshotPtr LogChannel::createSnapshot(std::chrono::nanoseconds timestamp)
+{
+  // multiple threads can take a snapshot at the same time, unless the plan
+  // must be rebuilt or the filters (deadband, delta) must be updated
+  std::shared_lock shared_lock(_p->mutex);
+  if(_p->sinks.empty())
+  {
+    return {};
+  }
+  if(_p->concurrentSnapshotAllowed())
+  {
+    return _p->createSnapshot(timestamp);
+  }
+  shared_lock.unlock();
+  std::lock_guard const lock(_p->mutex);
+  return _p->createSnapshot(timestamp);
+}
+
+const std::unordered_set<std::shared_ptr<DataSinkBase>>& LogChannel::sinks() const
+{
+  return _p->sinks;
+}
+
+bool LogChannel::takeSnapshot()
+{
+  return takeSnapshot(_p->clock->now());
+}
+
+void LogChannel::setClock(ClockBase::Ptr clock)
+{
+  if(!clock)
+  {
+    throw std::runtime_error("LogChannel::setClock: empty pointer");
+  }
+  std::lock_guard const lock(_p->mutex);
+  _p->clock = std::move(clock);
+}
+
+const ClockBase::Ptr& LogChannel::clock() const
+{
+  return _p->clock;
+}
 
+bool LogChannel::takeSnapshot(std::chrono::nanoseconds timestamp)
+{
+  // the same snapshot is shared by all the sinks, without copying it
+  const SnapshotPtr snapshot = createSnapshot(timestamp);
+  if(!snapshot)
+  {
+    return false;
+  }
   bool all_pushed = true;
   for(auto& sink : _p->sinks)
   {
-    all_pushed &= sink->pushSnapshot(_p->snapshot);
+    all_pushed &= sink->pushSnapshot(snapshot);
   }
   return all_pushed;
 }
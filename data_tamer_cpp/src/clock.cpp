@@ -0,0 +1,153 @@
+#include "data_tamer/clock.hpp"
+
+#include <cstring>
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define DATA_TAMER_HAS_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace DataTamer
+{
+
+namespace
+{
+int64_t SystemNsec()
+{
+  auto since_epoch = std::chrono::system_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count();
+}
+
+uint64_t ReadTSC()
+{
+#ifdef DATA_TAMER_HAS_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+}  // namespace
+
+std::chrono::nanoseconds SystemClock::now()
+{
+  return std::chrono::nanoseconds(SystemNsec());
+}
+
+std::chrono::nanoseconds SteadyClock::now()
+{
+  auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch);
+}
+
+bool TSCClock::IsAvailable()
+{
+#ifdef DATA_TAMER_HAS_TSC
+  // CPUID leaf 0x80000007, EDX bit 8: invariant TSC
+#ifdef _MSC_VER
+  int regs[4] = {};
+  __cpuid(regs, 0x80000000);
+  if(unsigned(regs[0]) < 0x80000007u)
+  {
+    return false;
+  }
+  __cpuid(regs, 0x80000007);
+  return (regs[3] & (1 << 8)) != 0;
+#else
+  unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if(__get_cpuid_max(0x80000000, nullptr) < 0x80000007)
+  {
+    return false;
+  }
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+  return (edx & (1u << 8)) != 0;
+#endif
+#else
+  return false;
+#endif
+}
+
+TSCClock::TSCClock(std::chrono::nanoseconds resync_period,
+                   std::chrono::nanoseconds calibration_time)
+  : available_(IsAvailable())
+{
+  if(!available_)
+  {
+    return;
+  }
+  first_tsc_ = ReadTSC();
+  first_nsec_ = SystemNsec();
+  std::this_thread::sleep_for(calibration_time);
+  const uint64_t tsc = ReadTSC();
+  const int64_t nsec = SystemNsec();
+
+  conversion_.base_tsc = tsc;
+  conversion_.base_nsec = nsec;
+  conversion_.nsec_per_tick = double(nsec - first_nsec_) / double(tsc - first_tsc_);
+  resync_ticks_ = uint64_t(double(resync_period.count()) / conversion_.nsec_per_tick);
+}
+
+TSCClock::Conversion TSCClock::loadConversion() const
+{
+  Conversion conversion;
+  uint64_t token = 0;
+  do
+  {
+    while(!seqlock_.readBegin(token))
+    {
+      std::this_thread::yield();
+    }
+    std::memcpy(&conversion, &conversion_, sizeof(Conversion));
+  } while(!seqlock_.readValidate(token));
+  return conversion;
+}
+
+void TSCClock::resync(uint64_t tsc)
+{
+  const int64_t nsec = SystemNsec();
+  Conversion conversion;
+  conversion.base_tsc = tsc;
+  conversion.base_nsec = nsec;
+  // the longer the interval, the more accurate the estimated frequency
+  conversion.nsec_per_tick = double(nsec - first_nsec_) / double(tsc - first_tsc_);
+
+  const SeqLockWriteGuard guard(seqlock_);
+  std::memcpy(&conversion_, &conversion, sizeof(Conversion));
+}
+
+std::chrono::nanoseconds TSCClock::now()
+{
+  if(!available_)
+  {
+    return std::chrono::nanoseconds(SystemNsec());
+  }
+  const uint64_t tsc = ReadTSC();
+  const Conversion conversion = loadConversion();
+  // negative if another thread updated the conversion after ReadTSC()
+  const auto elapsed = int64_t(tsc - conversion.base_tsc);
+
+  // only one thread synchronizes, the others keep using the previous conversion
+  if(elapsed > int64_t(resync_ticks_) && !resyncing_.exchange(true, std::memory_order_acquire))
+  {
+    resync(tsc);
+    resyncing_.store(false, std::memory_order_release);
+  }
+  return std::chrono::nanoseconds(conversion.base_nsec +
+                                  int64_t(double(elapsed) * conversion.nsec_per_tick));
+}
+
+double TSCClock::ticksPerNanosecond()
+{
+  if(!available_)
+  {
+    return 0;
+  }
+  return 1.0 / loadConversion().nsec_per_tick;
+}
+
+}  // namespace DataTamer
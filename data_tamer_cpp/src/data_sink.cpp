@@ -1,7 +1,10 @@
 #include "data_tamer/data_sink.hpp"
-#include "ConcurrentQueue/concurrentqueue.h"
+#include "ConcurrentQueue/blockingconcurrentqueue.h"
 
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 
 namespace DataTamer
@@ -9,27 +12,127 @@ namespace DataTamer
 
 struct DataSinkBase::Pimpl
 {
-  Pimpl(DataSinkBase* self)
+  // maximum number of snapshots passed at once to storeSnapshots()
+  static constexpr size_t kMaxBatchSize = 64;
+  // the thread wakes up periodically, even if the queue is empty
+  static constexpr std::int64_t kWaitTimeoutUsec = 100'000;
+
+  Pimpl(DataSinkBase* self) : queue(kDefaultQueueCapacity)
   {
     run = true;
 
     thread = std::thread([this, self]() {
-      Snapshot snapshot_copy;
+      std::vector<SnapshotPtr> batch(kMaxBatchSize);
       while(run)
       {
-        while(queue.try_dequeue(snapshot_copy))
+        // block until at least one snapshot is available, then take as many
+        // as possible, without busy waiting.
+        const size_t popped =
+            queue.wait_dequeue_bulk_timed(batch.data(), kMaxBatchSize, kWaitTimeoutUsec);
+        // an empty pointer is pushed by stopThread() to wake up this thread,
+        // or by reserveQueue()
+        const auto count = size_t(
+            std::remove(batch.begin(), batch.begin() + long(popped), nullptr) -
+            batch.begin());
+        if(count > 0)
+        {
+          releaseSlots(count);
+          self->storeSnapshots({ batch.data(), count });
+          stored += count;
+        }
+        else if(popped == 0 && run && stored > 0)
+        {
+          // after the first snapshot, we know that the derived class is fully constructed
+          self->onIdle();
+        }
+        // release them as soon as possible, to return them to their pool
+        for(size_t i = 0; i < popped; i++)
         {
-          self->storeSnapshot(snapshot_copy);
+          batch[i].reset();
         }
-        // avoid busy loop
-        std::this_thread::sleep_for(std::chrono::microseconds(250));
       }
     });
   }
 
+  // try to increment the number of queued snapshots, without exceeding the capacity
+  bool reserveSlot()
+  {
+    if(queued.fetch_add(1) < capacity)
+    {
+      return true;
+    }
+    queued--;
+    return false;
+  }
+
+  // reserve all the slots or none of them
+  bool reserveSlots(size_t count)
+  {
+    if(queued.fetch_add(count) + count <= capacity)
+    {
+      return true;
+    }
+    queued -= count;
+    return false;
+  }
+
+  void releaseSlots(size_t count)
+  {
+    queued -= count;
+    if(blocked_producers > 0)
+    {
+      std::lock_guard lk(slots_mutex);
+      slots_cv.notify_all();
+    }
+  }
+
+  // Allocate the memory of the queue for at least `count` snapshots.
+  // The queue can't be resized, but the blocks of memory used by the queue are
+  // recycled once they are empty: empty pointers are pushed to allocate them
+  // all at once and then they are discarded by the consumer thread.
+  void reserveQueue(size_t count)
+  {
+    std::scoped_lock lk(reserve_mutex);
+    if(count > reserved)
+    {
+      const std::vector<SnapshotPtr> placeholders(count);
+      queue.enqueue_bulk(placeholders.data(), placeholders.size());
+      reserved = count;
+    }
+  }
+
+  // used by OverflowPolicy::BLOCK
+  bool waitSlot()
+  {
+    blocked_producers++;
+    std::unique_lock lk(slots_mutex);
+    const bool reserved =
+        slots_cv.wait_for(lk, block_timeout.load(), [this] { return reserveSlot(); });
+    blocked_producers--;
+    return reserved;
+  }
+
   std::thread thread;
   std::atomic_bool run = true;
-  moodycamel::ConcurrentQueue<Snapshot> queue;
+  moodycamel::BlockingConcurrentQueue<SnapshotPtr> queue;
+
+  std::atomic_size_t capacity = kDefaultQueueCapacity;
+  // number of snapshots the memory of the queue was allocated for
+  size_t reserved = kDefaultQueueCapacity;
+  std::mutex reserve_mutex;
+  std::atomic_size_t queued = 0;
+  std::atomic<OverflowPolicy> policy = OverflowPolicy::DROP_NEWEST;
+  std::atomic<std::chrono::microseconds> block_timeout{ std::chrono::milliseconds(10) };
+
+  std::mutex slots_mutex;
+  std::condition_variable slots_cv;
+  std::atomic_int blocked_producers = 0;
+
+  std::atomic_uint64_t enqueued = 0;
+  std::atomic_uint64_t dropped = 0;
+  std::atomic_uint64_t stored = 0;
+  // enqueued, but removed by OverflowPolicy::DROP_OLDEST
+  std::atomic_uint64_t evicted = 0;
 };
 
 DataSinkBase::DataSinkBase() : _p(new Pimpl(this)) {}
@@ -39,9 +142,131 @@ DataSinkBase::~DataSinkBase()
   stopThread();
 }
 
+bool DataSinkBase::pushSnapshot(const SnapshotPtr& snapshot)
+{
+  if(!_p->reserveSlot())
+  {
+    switch(_p->policy.load())
+    {
+      case OverflowPolicy::DROP_NEWEST:
+        _p->dropped++;
+        return false;
+
+      case OverflowPolicy::DROP_OLDEST: {
+        // the slot of the oldest snapshot is given to the new one
+        SnapshotPtr oldest;
+        if(_p->queue.try_dequeue(oldest) && !oldest)
+        {
+          // not a snapshot: the empty pointer must still wake up the consumer
+          _p->queue.enqueue(SnapshotPtr{});
+        }
+        if(oldest)
+        {
+          _p->dropped++;
+          _p->evicted++;
+        }
+        // the consumer emptied the queue in the meantime
+        else if(!_p->reserveSlot())
+        {
+          _p->dropped++;
+          return false;
+        }
+      }
+      break;
+
+      case OverflowPolicy::BLOCK:
+        if(!_p->waitSlot())
+        {
+          _p->dropped++;
+          return false;
+        }
+        break;
+    }
+  }
+  _p->queue.enqueue(snapshot);
+  _p->enqueued++;
+  return true;
+}
+
 bool DataSinkBase::pushSnapshot(const Snapshot& snapshot)
 {
-  return _p->queue.enqueue(snapshot);
+  return pushSnapshot(std::make_shared<const Snapshot>(snapshot));
+}
+
+bool DataSinkBase::pushSnapshots(SnapshotsSpan snapshots)
+{
+  if(!_p->reserveSlots(snapshots.size()))
+  {
+    bool all_pushed = true;
+    for(size_t i = 0; i < snapshots.size(); i++)
+    {
+      all_pushed &= pushSnapshot(snapshots.data()[i]);
+    }
+    return all_pushed;
+  }
+  _p->queue.enqueue_bulk(snapshots.data(), snapshots.size());
+  _p->enqueued += snapshots.size();
+  return true;
+}
+
+void DataSinkBase::setQueueCapacity(size_t capacity)
+{
+  _p->capacity = capacity;
+  _p->reserveQueue(capacity);
+}
+
+size_t DataSinkBase::maxPendingSnapshots() const
+{
+  // the slots of a batch are released before storeSnapshots() is called
+  return _p->capacity + Pimpl::kMaxBatchSize;
+}
+
+void DataSinkBase::setOverflowPolicy(OverflowPolicy policy,
+                                     std::chrono::microseconds block_timeout)
+{
+  _p->policy = policy;
+  _p->block_timeout = block_timeout;
+}
+
+SinkStatistics DataSinkBase::getStatistics() const
+{
+  SinkStatistics stats;
+  stats.enqueued = _p->enqueued;
+  stats.dropped = _p->dropped;
+  stats.stored = _p->stored;
+  return stats;
+}
+
+bool DataSinkBase::storeSnapshots(SnapshotsSpan snapshots)
+{
+  bool all_stored = true;
+  for(size_t i = 0; i < snapshots.size(); i++)
+  {
+    all_stored &= storeSnapshot(*snapshots.data()[i]);
+  }
+  return all_stored;
+}
+
+bool DataSinkBase::waitQueueDrained(std::chrono::milliseconds timeout) const
+{
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  const uint64_t target = _p->enqueued;
+  while(_p->stored + _p->evicted < target)
+  {
+    if(std::chrono::steady_clock::now() >= deadline || !_p->thread.joinable())
+    {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+  return true;
+}
+
+void DataSinkBase::updateStatistics(uint64_t stored, uint64_t dropped)
+{
+  _p->enqueued += stored;
+  _p->stored += stored;
+  _p->dropped += dropped;
 }
 
 void DataSinkBase::stopThread()
@@ -49,6 +274,8 @@ void DataSinkBase::stopThread()
   _p->run = false;
   if(_p->thread.joinable())
   {
+    // wake up the thread, if it is waiting
+    _p->queue.enqueue(SnapshotPtr{});
     _p->thread.join();
   }
 }
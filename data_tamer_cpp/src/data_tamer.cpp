@@ -1,22 +1,306 @@
 #include "data_tamer/data_tamer.hpp"
 
+#include <algorithm>
+#include <condition_variable>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace DataTamer
 {
 
+namespace
+{
+bool SetThreadAffinity([[maybe_unused]] std::thread::native_handle_type handle,
+                       [[maybe_unused]] int cpu)
+{
+#ifdef __linux__
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  if(cpu < 0)
+  {
+    for(int i = 0; i < CPU_SETSIZE; i++)
+    {
+      CPU_SET(i, &cpuset);
+    }
+  }
+  else
+  {
+    CPU_SET(cpu, &cpuset);
+  }
+  return pthread_setaffinity_np(handle, sizeof(cpu_set_t), &cpuset) == 0;
+#else
+  return false;
+#endif
+}
+}  // namespace
+
 struct ChannelsRegistry::Pimpl
 {
   std::unordered_map<std::string, std::shared_ptr<LogChannel>> channels;
   std::unordered_set<std::shared_ptr<DataSinkBase>> default_sinks;
   Mutex mutex;
+  ClockBase::Ptr clock = std::make_shared<SystemClock>();
+
+  using Clock = std::chrono::steady_clock;
+
+  struct ScheduledChannel
+  {
+    std::shared_ptr<LogChannel> channel;
+    ScheduleStatistics stats;
+    std::chrono::nanoseconds total_jitter = {};
+  };
+
+  // channels with the same period
+  struct ScheduleGroup
+  {
+    std::chrono::nanoseconds period = {};
+    Clock::time_point deadline;
+    std::map<std::string, ScheduledChannel> channels;
+  };
+
+  // the key is the period
+  std::map<std::chrono::nanoseconds, ScheduleGroup> schedule_groups;
+  mutable std::mutex schedule_mutex;
+  std::condition_variable schedule_cv;
+  std::thread scheduler_thread;
+  bool scheduler_run = false;
+  int scheduler_cpu = -1;
+
+  // snapshots of a group for one sink, and the index of their channels in the group
+  struct SinkBatch
+  {
+    DataSinkBase* sink = nullptr;
+    std::vector<SnapshotPtr> snapshots;
+    std::vector<size_t> channels;
+  };
+  using ChannelResults = std::vector<std::pair<LogChannel*, bool>>;
+
+  // used only by the scheduler thread, to avoid allocations at each period
+  std::vector<std::shared_ptr<LogChannel>> group_channels;
+  ChannelResults group_results;
+  std::vector<SinkBatch> group_batches;
+  std::vector<std::chrono::nanoseconds> due_periods;
+
+  // Take the snapshots of the group and push them with a single pushSnapshots()
+  // for each sink. The result of group[i] is written into results[i].
+  // The vectors are cleared, but their memory is kept for the next call.
+  static void snapshotChannels(const std::vector<std::shared_ptr<LogChannel>>& group,
+                               std::chrono::nanoseconds timestamp,
+                               std::vector<SinkBatch>& batches, ChannelResults& results);
+
+  void schedulerLoop();
+  // must be called holding schedule_mutex, that is released while taking the snapshots
+  void snapshotGroup(std::unique_lock<std::mutex>& lk, std::chrono::nanoseconds period);
+  void stopScheduler();
+  // must be called holding schedule_mutex
+  void removeScheduled(std::string const& channel_name);
 };
 
+void ChannelsRegistry::Pimpl::schedulerLoop()
+{
+  std::unique_lock lk(schedule_mutex);
+  while(scheduler_run)
+  {
+    if(schedule_groups.empty())
+    {
+      schedule_cv.wait(lk);
+      continue;
+    }
+    auto next_deadline = Clock::time_point::max();
+    for(auto const& [period, group] : schedule_groups)
+    {
+      next_deadline = std::min(next_deadline, group.deadline);
+    }
+    if(Clock::now() < next_deadline)
+    {
+      // woken up earlier if the schedule changes
+      schedule_cv.wait_until(lk, next_deadline);
+      continue;
+    }
+    const auto now = Clock::now();
+    due_periods.clear();
+    for(auto const& [period, group] : schedule_groups)
+    {
+      if(group.deadline <= now)
+      {
+        due_periods.push_back(period);
+      }
+    }
+    // the groups may change while the lock is released by snapshotGroup()
+    for(const auto period : due_periods)
+    {
+      snapshotGroup(lk, period);
+    }
+  }
+}
+
+void ChannelsRegistry::Pimpl::snapshotGroup(std::unique_lock<std::mutex>& lk,
+                                            std::chrono::nanoseconds period)
+{
+  auto it = schedule_groups.find(period);
+  if(!scheduler_run || it == schedule_groups.end())
+  {
+    return;
+  }
+  const auto deadline = it->second.deadline;
+  // the delay of the wake-up is the same for all the channels of the group
+  const auto jitter = Clock::now() - deadline;
+  const auto group_clock = clock;
+  group_channels.clear();
+  for(auto const& [name, entry] : it->second.channels)
+  {
+    group_channels.push_back(entry.channel);
+  }
+
+  // schedule() and getScheduleStatistics() must not wait for the snapshots
+  lk.unlock();
+  // one timestamp for the entire group
+  const auto timestamp = group_clock->now();
+  snapshotChannels(group_channels, timestamp, group_batches, group_results);
+  group_channels.clear();
+  lk.lock();
+
+  // the group, or some of its channels, may have been removed in the meantime
+  it = schedule_groups.find(period);
+  if(it == schedule_groups.end() || it->second.deadline != deadline)
+  {
+    return;
+  }
+  auto& group = it->second;
+  for(auto& [name, entry] : group.channels)
+  {
+    const auto* channel = entry.channel.get();
+    auto result =
+        std::find_if(group_results.begin(), group_results.end(),
+                     [channel](const auto& res) { return res.first == channel; });
+    if(result == group_results.end())
+    {
+      continue;
+    }
+    auto& stats = entry.stats;
+    stats.max_jitter = std::max(stats.max_jitter, jitter);
+    entry.total_jitter += jitter;
+    if(result->second)
+    {
+      stats.snapshots++;
+    }
+    else
+    {
+      stats.failed++;
+    }
+    stats.mean_jitter = entry.total_jitter / (stats.snapshots + stats.failed);
+  }
+
+  group.deadline += group.period;
+  const auto now = Clock::now();
+  if(group.deadline <= now)
+  {
+    // skip the periods that are already expired, keeping the original phase
+    const auto missed = (now - group.deadline) / group.period + 1;
+    group.deadline += missed * group.period;
+    for(auto& [name, entry] : group.channels)
+    {
+      entry.stats.overruns += uint64_t(missed);
+    }
+  }
+}
+
+void ChannelsRegistry::Pimpl::snapshotChannels(
+    const std::vector<std::shared_ptr<LogChannel>>& group, std::chrono::nanoseconds timestamp,
+    std::vector<SinkBatch>& batches, ChannelResults& results)
+{
+  results.clear();
+  for(size_t index = 0; index < group.size(); index++)
+  {
+    auto const& channel = group[index];
+    auto snapshot = channel->createSnapshot(timestamp);
+    results.emplace_back(channel.get(), bool(snapshot));
+    if(!snapshot)
+    {
+      continue;
+    }
+    // usually just a few sinks
+    for(auto const& sink : channel->sinks())
+    {
+      auto it = std::find_if(batches.begin(), batches.end(),
+                             [&sink](const auto& batch) { return batch.sink == sink.get(); });
+      if(it == batches.end())
+      {
+        batches.emplace_back();
+        it = std::prev(batches.end());
+        it->sink = sink.get();
+      }
+      it->snapshots.push_back(snapshot);
+      it->channels.push_back(index);
+    }
+  }
+  for(auto& batch : batches)
+  {
+    if(!batch.snapshots.empty() &&
+       !batch.sink->pushSnapshots({ batch.snapshots.data(), batch.snapshots.size() }))
+    {
+      for(const auto index : batch.channels)
+      {
+        results[index].second = false;
+      }
+    }
+  }
+  // forget the sinks that were not used, they might have been destroyed
+  batches.erase(std::remove_if(batches.begin(), batches.end(),
+                               [](const auto& batch) { return batch.snapshots.empty(); }),
+                batches.end());
+  for(auto& batch : batches)
+  {
+    // release the snapshots, keeping the capacity
+    batch.snapshots.clear();
+    batch.channels.clear();
+  }
+}
+
+void ChannelsRegistry::Pimpl::stopScheduler()
+{
+  {
+    std::scoped_lock lk(schedule_mutex);
+    scheduler_run = false;
+    schedule_groups.clear();
+  }
+  schedule_cv.notify_all();
+  if(scheduler_thread.joinable())
+  {
+    scheduler_thread.join();
+  }
+}
+
+void ChannelsRegistry::Pimpl::removeScheduled(std::string const& channel_name)
+{
+  for(auto it = schedule_groups.begin(); it != schedule_groups.end(); it++)
+  {
+    if(it->second.channels.erase(channel_name) > 0)
+    {
+      if(it->second.channels.empty())
+      {
+        schedule_groups.erase(it);
+      }
+      return;
+    }
+  }
+}
+
 ChannelsRegistry::ChannelsRegistry() : _p(new Pimpl) {}
 
-ChannelsRegistry::~ChannelsRegistry() {}
+ChannelsRegistry::~ChannelsRegistry()
+{
+  _p->stopScheduler();
+}
 
 ChannelsRegistry& ChannelsRegistry::Global()
 {
@@ -37,6 +321,7 @@ std::shared_ptr<LogChannel> ChannelsRegistry::getChannel(std::string const& chan
   if(it == _p->channels.end())
   {
     auto new_channel = LogChannel::create(channel_name);
+    new_channel->setClock(_p->clock);
     for(auto const& sink : _p->default_sinks)
     {
       new_channel->addDataSink(sink);
@@ -49,9 +334,106 @@ std::shared_ptr<LogChannel> ChannelsRegistry::getChannel(std::string const& chan
 
 void ChannelsRegistry::clear()
 {
+  _p->stopScheduler();
   std::scoped_lock lk(_p->mutex);
   _p->channels.clear();
   _p->default_sinks.clear();
 }
 
+bool ChannelsRegistry::takeSnapshot(const std::vector<std::shared_ptr<LogChannel>>& group,
+                                    std::chrono::nanoseconds timestamp)
+{
+  std::vector<Pimpl::SinkBatch> batches;
+  Pimpl::ChannelResults results;
+  Pimpl::snapshotChannels(group, timestamp, batches, results);
+  return std::all_of(results.begin(), results.end(),
+                     [](const auto& result) { return result.second; });
+}
+
+bool ChannelsRegistry::takeSnapshot(const std::vector<std::shared_ptr<LogChannel>>& group)
+{
+  return takeSnapshot(group, _p->clock->now());
+}
+
+void ChannelsRegistry::setClock(ClockBase::Ptr clock)
+{
+  if(!clock)
+  {
+    throw std::runtime_error("ChannelsRegistry::setClock: empty pointer");
+  }
+  // the scheduler thread reads the clock holding schedule_mutex
+  std::scoped_lock lk(_p->mutex, _p->schedule_mutex);
+  _p->clock = std::move(clock);
+}
+
+void ChannelsRegistry::schedule(std::string const& channel_name,
+                                std::chrono::nanoseconds period)
+{
+  if(period.count() <= 0)
+  {
+    throw std::runtime_error("The period of a scheduled channel must be positive");
+  }
+  auto channel = getChannel(channel_name);
+  {
+    std::scoped_lock lk(_p->schedule_mutex);
+    _p->removeScheduled(channel_name);
+
+    auto [it, inserted] = _p->schedule_groups.try_emplace(period);
+    auto& group = it->second;
+    if(inserted)
+    {
+      group.period = period;
+      group.deadline = Pimpl::Clock::now() + period;
+    }
+    group.channels[channel_name].channel = channel;
+
+    if(!_p->scheduler_run)
+    {
+      _p->scheduler_run = true;
+      _p->scheduler_thread = std::thread(&Pimpl::schedulerLoop, _p.get());
+      if(_p->scheduler_cpu >= 0)
+      {
+        SetThreadAffinity(_p->scheduler_thread.native_handle(), _p->scheduler_cpu);
+      }
+    }
+  }
+  _p->schedule_cv.notify_all();
+}
+
+void ChannelsRegistry::unschedule(std::string const& channel_name)
+{
+  std::scoped_lock lk(_p->schedule_mutex);
+  _p->removeScheduled(channel_name);
+}
+
+std::optional<ScheduleStatistics>
+ChannelsRegistry::getScheduleStatistics(std::string const& channel_name) const
+{
+  std::scoped_lock lk(_p->schedule_mutex);
+  for(auto const& [period, group] : _p->schedule_groups)
+  {
+    auto it = group.channels.find(channel_name);
+    if(it != group.channels.end())
+    {
+      return it->second.stats;
+    }
+  }
+  return std::nullopt;
+}
+
+bool ChannelsRegistry::setSchedulerAffinity(int cpu)
+{
+  std::scoped_lock lk(_p->schedule_mutex);
+  _p->scheduler_cpu = cpu;
+  if(_p->scheduler_thread.joinable())
+  {
+    return SetThreadAffinity(_p->scheduler_thread.native_handle(), cpu);
+  }
+#ifdef __linux__
+  return true;
+#else
+  return false;
+#endif
+}
+
 }  // namespace DataTamer
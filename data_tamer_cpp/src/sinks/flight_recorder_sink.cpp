@@ -0,0 +1,258 @@
+#include "data_tamer/sinks/flight_recorder_sink.hpp"
+#include "data_tamer/sinks/mcap_sink.hpp"
+
+namespace DataTamer
+{
+
+FlightRecorderSink::FlightRecorderSink(std::string const& filepath_prefix,
+                                       FlightRecorderOptions const& options)
+  : options_(options), filepath_prefix_(filepath_prefix), ring_(options.max_snapshots)
+{
+  dump_thread_ = std::thread([this]() { dumpLoop(); });
+}
+
+FlightRecorderSink::~FlightRecorderSink()
+{
+  stopThread();
+  // the post-trigger window will never be completed: save what we have
+  collectPendingDump(true);
+  {
+    std::scoped_lock lk(mutex_);
+    stop_ = true;
+  }
+  dump_cv_.notify_all();
+  dump_thread_.join();
+}
+
+void FlightRecorderSink::addChannel(std::string const& channel_name, Schema const& schema)
+{
+  std::scoped_lock lk(mutex_);
+  schemas_[schema.hash] = { channel_name, schema };
+}
+
+bool FlightRecorderSink::storeSnapshot(const Snapshot& snapshot)
+{
+  // not called by the consumer thread (see storeSnapshots): the ring needs its own copy
+  processSnapshot(std::make_shared<const Snapshot>(snapshot));
+  return true;
+}
+
+bool FlightRecorderSink::storeSnapshots(SnapshotsSpan snapshots)
+{
+  for(size_t i = 0; i < snapshots.size(); i++)
+  {
+    processSnapshot(snapshots.data()[i]);
+  }
+  return true;
+}
+
+void FlightRecorderSink::processSnapshot(const SnapshotPtr& snapshot_ptr)
+{
+  const Snapshot& snapshot = *snapshot_ptr;
+  pushIntoRing(snapshot_ptr);
+  {
+    std::scoped_lock lk(mutex_);
+    if(predicate_ && !pending_dump_ && predicate_(snapshot))
+    {
+      requestDump({});
+    }
+    if(pending_dump_ && !pending_dump_->trigger_time)
+    {
+      pending_dump_->trigger_time = snapshot.timestamp;
+    }
+  }
+  collectPendingDump(false);
+
+  // remove the snapshots that will not be part of any dump. This is done after
+  // collectPendingDump, because the new snapshot may be much more recent than the
+  // previous ones.
+  const auto retention = options_.pre_trigger + options_.post_trigger;
+  while(ring_count_ > 0 && ring_[ring_head_]->timestamp < snapshot.timestamp - retention)
+  {
+    popFromRing();
+  }
+}
+
+bool FlightRecorderSink::trigger(std::string const& filepath)
+{
+  std::scoped_lock lk(mutex_);
+  return requestDump(filepath);
+}
+
+void FlightRecorderSink::setTriggerPredicate(TriggerPredicate predicate)
+{
+  std::scoped_lock lk(mutex_);
+  predicate_ = std::move(predicate);
+}
+
+bool FlightRecorderSink::waitForDumps(std::chrono::milliseconds timeout)
+{
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  // a dump requested by the predicate is known only after the consumer thread
+  // processed the snapshots already pushed
+  if(!waitQueueDrained(timeout))
+  {
+    return false;
+  }
+  std::unique_lock lk(mutex_);
+  return done_cv_.wait_until(lk, deadline, [this] { return dumps_in_progress_ == 0; });
+}
+
+std::vector<std::string> FlightRecorderSink::dumpedFiles() const
+{
+  std::scoped_lock lk(mutex_);
+  return dumped_files_;
+}
+
+bool FlightRecorderSink::requestDump(std::string const& filepath)
+{
+  if(pending_dump_)
+  {
+    return false;
+  }
+  pending_dump_ = DumpRequest{};
+  pending_dump_->filepath = filepath;
+  if(filepath.empty())
+  {
+    pending_dump_->filepath =
+        filepath_prefix_ + "_" + std::to_string(++dump_counter_) + ".mcap";
+  }
+  dumps_in_progress_++;
+  return true;
+}
+
+void FlightRecorderSink::pushIntoRing(const SnapshotPtr& snapshot)
+{
+  if(ring_.empty())
+  {
+    return;
+  }
+  const size_t size = snapshot->active_mask.size() + snapshot->payload.size();
+  while(ring_count_ > 0 &&
+        (ring_count_ == ring_.size() || ring_bytes_ + size > options_.max_bytes))
+  {
+    popFromRing();
+  }
+  ring_[(ring_head_ + ring_count_) % ring_.size()] = snapshot;
+  ring_count_++;
+  ring_bytes_ += size;
+}
+
+void FlightRecorderSink::popFromRing()
+{
+  auto& oldest = ring_[ring_head_];
+  ring_bytes_ -= oldest->active_mask.size() + oldest->payload.size();
+  // return it to the pool of its channel, unless a dump still uses it
+  oldest.reset();
+  ring_head_ = (ring_head_ + 1) % ring_.size();
+  ring_count_--;
+}
+
+void FlightRecorderSink::collectPendingDump(bool force)
+{
+  std::optional<DumpRequest> dump;
+  {
+    std::scoped_lock lk(mutex_);
+    if(!pending_dump_)
+    {
+      return;
+    }
+    if(ring_count_ > 0)
+    {
+      const auto newest = ring_[(ring_head_ + ring_count_ - 1) % ring_.size()]->timestamp;
+      if(!pending_dump_->trigger_time && force)
+      {
+        pending_dump_->trigger_time = newest;
+      }
+      if(pending_dump_->trigger_time &&
+         (force || newest >= *pending_dump_->trigger_time + options_.post_trigger))
+      {
+        dump.swap(pending_dump_);
+      }
+    }
+    else if(force)
+    {
+      // nothing to save
+      pending_dump_.reset();
+      dumps_in_progress_--;
+      done_cv_.notify_all();
+      return;
+    }
+  }
+  if(!dump)
+  {
+    return;
+  }
+  // share the window with the dump thread: only the pointers are copied
+  const auto from = *dump->trigger_time - options_.pre_trigger;
+  const auto to = *dump->trigger_time + options_.post_trigger;
+  for(size_t i = 0; i < ring_count_; i++)
+  {
+    const auto& snapshot = ring_[(ring_head_ + i) % ring_.size()];
+    if(snapshot->timestamp >= from && snapshot->timestamp <= to)
+    {
+      dump->snapshots.push_back(snapshot);
+    }
+  }
+  {
+    std::scoped_lock lk(mutex_);
+    dump_queue_.push_back(std::move(*dump));
+  }
+  dump_cv_.notify_one();
+}
+
+void FlightRecorderSink::dumpLoop()
+{
+  while(true)
+  {
+    std::unique_lock lk(mutex_);
+    dump_cv_.wait(lk, [this] { return stop_ || !dump_queue_.empty(); });
+    if(dump_queue_.empty())
+    {
+      return;
+    }
+    const DumpRequest dump = std::move(dump_queue_.front());
+    dump_queue_.pop_front();
+    const auto schemas = schemas_;
+    lk.unlock();
+
+    const bool written = writeDump(dump, schemas);
+
+    lk.lock();
+    if(written)
+    {
+      dumped_files_.push_back(dump.filepath);
+    }
+    dumps_in_progress_--;
+    done_cv_.notify_all();
+  }
+}
+
+bool FlightRecorderSink::writeDump(
+    const DumpRequest& dump,
+    const std::unordered_map<size_t, std::pair<std::string, Schema>>& schemas)
+{
+  try
+  {
+    // reuse the schema and channel handling of the MCAPSink. Its own consumer
+    // thread is never used, because we call storeSnapshot() directly.
+    MCAPSink writer(dump.filepath, options_.do_compression);
+    writer.setMaxTimeBeforeReset(std::chrono::seconds(0));
+    for(const auto& [hash, channel] : schemas)
+    {
+      writer.addChannel(channel.first, channel.second);
+    }
+    for(const auto& snapshot : dump.snapshots)
+    {
+      writer.storeSnapshot(*snapshot);
+    }
+    writer.stopRecording();
+  }
+  catch(std::exception&)
+  {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace DataTamer
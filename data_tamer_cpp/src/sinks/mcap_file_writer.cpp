@@ -0,0 +1,559 @@
+#include "mcap_file_writer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace DataTamer
+{
+
+namespace
+{
+// Same thresholds of mcap::McapWriter.
+// Both LZ4 and ZSTD recommend ~1KB as the minimum size for compressed data
+constexpr uint64_t kMinCompressionSize = 1024;
+// Throw away any compression results that save less than 2% of the original size
+constexpr double kMinCompressionRatio = 1.02;
+
+std::string CompressionName(mcap::Compression compression)
+{
+  switch(compression)
+  {
+    case mcap::Compression::Lz4:
+      return "lz4";
+    case mcap::Compression::Zstd:
+      return "zstd";
+    default:
+      return {};
+  }
+}
+}  // namespace
+
+MCAPFileWriter::OutputFile::~OutputFile()
+{
+  end();
+}
+
+bool MCAPFileWriter::OutputFile::open(std::string const& filepath)
+{
+  file_ = std::fopen(filepath.c_str(), "wb");
+  return file_ != nullptr;
+}
+
+void MCAPFileWriter::OutputFile::handleWrite(const std::byte* data, uint64_t size)
+{
+  std::fwrite(data, 1, size, file_);
+  size_ += size;
+}
+
+void MCAPFileWriter::OutputFile::end()
+{
+  if(file_)
+  {
+    std::fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+void MCAPFileWriter::OutputFile::flush(MCAPSinkOptions::SyncPolicy policy)
+{
+  if(!file_ || policy == MCAPSinkOptions::SyncPolicy::NONE)
+  {
+    return;
+  }
+  std::fflush(file_);
+  if(policy == MCAPSinkOptions::SyncPolicy::DATA_SYNC)
+  {
+#if defined(_WIN32)
+    _commit(_fileno(file_));
+#elif defined(__APPLE__)
+    fsync(fileno(file_));
+#else
+    fdatasync(fileno(file_));
+#endif
+  }
+}
+
+MCAPFileWriter::MCAPFileWriter(std::string const& filepath,
+                               const mcap::McapWriterOptions& options,
+                               const MCAPSinkOptions& sink_options)
+  : options_(options)
+  , max_chunk_age_(sink_options.max_chunk_age)
+  , sync_policy_(sink_options.sync_policy)
+  , last_sync_(Clock::now())
+{
+  const size_t compression_threads = sink_options.compression_threads;
+  if(!output_.open(filepath))
+  {
+    throw std::runtime_error("Failed to open MCAP file for writing");
+  }
+  opened_ = true;
+  output_.crcEnabled = options_.enableDataCRC;
+  mcap::McapWriter::writeMagic(output_);
+  mcap::McapWriter::write(output_, mcap::Header{ options_.profile, options_.library });
+  file_size_ = output_.size();
+
+  if(options_.noChunking || options_.chunkSize == 0)
+  {
+    // messages are written directly into the file
+    return;
+  }
+  current_chunk_ = createChunk();
+  if(compression_threads == 0)
+  {
+    return;
+  }
+  // one chunk being filled, plus one being written and one being compressed per worker
+  for(size_t i = 0; i < compression_threads + 1; i++)
+  {
+    free_chunks_.push_back(createChunk());
+  }
+  for(size_t i = 0; i < compression_threads; i++)
+  {
+    workers_.emplace_back(&MCAPFileWriter::compressLoop, this);
+  }
+  writer_thread_ = std::thread(&MCAPFileWriter::writeLoop, this);
+}
+
+MCAPFileWriter::~MCAPFileWriter()
+{
+  close();
+}
+
+std::unique_ptr<MCAPFileWriter::Chunk> MCAPFileWriter::createChunk() const
+{
+  auto chunk = std::make_unique<Chunk>();
+  switch(options_.compression)
+  {
+    case mcap::Compression::None:
+      chunk->records = std::make_unique<mcap::BufferWriter>();
+      break;
+#ifndef MCAP_COMPRESSION_NO_LZ4
+    case mcap::Compression::Lz4:
+      chunk->records =
+          std::make_unique<mcap::LZ4Writer>(options_.compressionLevel, options_.chunkSize);
+      break;
+#endif
+#ifndef MCAP_COMPRESSION_NO_ZSTD
+    case mcap::Compression::Zstd:
+      chunk->records =
+          std::make_unique<mcap::ZStdWriter>(options_.compressionLevel, options_.chunkSize);
+      break;
+#endif
+    default:
+      throw std::runtime_error("MCAPFileWriter: the requested compression is not available");
+  }
+  chunk->records->crcEnabled = !options_.noChunkCRC;
+  return chunk;
+}
+
+void MCAPFileWriter::addSchema(mcap::Schema& schema)
+{
+  schema.id = uint16_t(schemas_.size() + 1);
+  schemas_.push_back(schema);
+}
+
+void MCAPFileWriter::addChannel(mcap::Channel& channel)
+{
+  channel.id = uint16_t(channels_.size() + 1);
+  channels_.push_back(channel);
+}
+
+void MCAPFileWriter::copyChannels(const MCAPFileWriter& other)
+{
+  schemas_ = other.schemas_;
+  channels_ = other.channels_;
+}
+
+void MCAPFileWriter::write(const mcap::Message& message)
+{
+  write(message, { DataView{ message.data, message.dataSize } });
+}
+
+void MCAPFileWriter::write(const mcap::Message& message, std::initializer_list<DataView> parts)
+{
+  if(!opened_)
+  {
+    return;
+  }
+  mcap::IWritable& output =
+      current_chunk_ ? static_cast<mcap::IWritable&>(*current_chunk_->records) : output_;
+  if(current_chunk_ && current_chunk_->records->empty())
+  {
+    current_chunk_->creation_time = Clock::now();
+  }
+  auto& channel_message_counts = statistics_.channelMessageCounts;
+
+  // Write the Channel (and its Schema) the first time it is used
+  if(channel_message_counts.count(message.channelId) == 0)
+  {
+    const size_t channel_index = message.channelId - 1;
+    if(channel_index >= channels_.size())
+    {
+      throw std::runtime_error("MCAPFileWriter: invalid channel id");
+    }
+    const auto& channel = channels_[channel_index];
+    if(channel.schemaId != 0 && written_schemas_.insert(channel.schemaId).second)
+    {
+      mcap::McapWriter::write(output, schemas_.at(channel.schemaId - 1));
+      ++statistics_.schemaCount;
+    }
+    mcap::McapWriter::write(output, channel);
+    channel_message_counts.emplace(message.channelId, 0);
+    ++statistics_.channelCount;
+  }
+
+  const uint64_t message_offset = output.size();
+
+  // Same layout of mcap::McapWriter::write(output, message), but the header
+  // is written at once and the data doesn't need to be contiguous
+  uint64_t data_size = 0;
+  for(const auto& part : parts)
+  {
+    data_size += part.size;
+  }
+  const uint64_t record_size = 2 + 4 + 8 + 8 + data_size;
+  std::array<std::byte, 1 + 8 + 2 + 4 + 8 + 8> header;
+  header[0] = std::byte(mcap::OpCode::Message);
+  std::memcpy(&header[1], &record_size, 8);
+  std::memcpy(&header[9], &message.channelId, 2);
+  std::memcpy(&header[11], &message.sequence, 4);
+  std::memcpy(&header[15], &message.logTime, 8);
+  std::memcpy(&header[23], &message.publishTime, 8);
+  output.write(header.data(), header.size());
+  for(const auto& part : parts)
+  {
+    output.write(static_cast<const std::byte*>(part.data), part.size);
+  }
+
+  if(!options_.noSummary)
+  {
+    if(statistics_.messageCount == 0)
+    {
+      statistics_.messageStartTime = message.logTime;
+      statistics_.messageEndTime = message.logTime;
+    }
+    else
+    {
+      statistics_.messageStartTime = std::min(statistics_.messageStartTime, message.logTime);
+      statistics_.messageEndTime = std::max(statistics_.messageEndTime, message.logTime);
+    }
+    ++statistics_.messageCount;
+    channel_message_counts[message.channelId] += 1;
+  }
+
+  if(!current_chunk_)
+  {
+    file_size_ = output_.size();
+    if(max_chunk_age_.count() > 0 && Clock::now() - last_sync_ >= max_chunk_age_)
+    {
+      output_.flush(sync_policy_);
+      last_sync_ = Clock::now();
+    }
+    return;
+  }
+  auto& chunk = *current_chunk_;
+  if(!options_.noMessageIndex)
+  {
+    auto& index = chunk.message_index[message.channelId];
+    index.channelId = message.channelId;
+    index.records.emplace_back(message.logTime, message_offset);
+  }
+  chunk.start_time = std::min(chunk.start_time, message.logTime);
+  chunk.end_time = std::max(chunk.end_time, message.logTime);
+
+  if(chunk.records->size() >= options_.chunkSize ||
+     (max_chunk_age_.count() > 0 && Clock::now() - chunk.creation_time >= max_chunk_age_))
+  {
+    submitChunk();
+  }
+}
+
+void MCAPFileWriter::closeOldChunk()
+{
+  if(!opened_ || max_chunk_age_.count() == 0)
+  {
+    return;
+  }
+  if(!current_chunk_)
+  {
+    if(Clock::now() - last_sync_ >= max_chunk_age_)
+    {
+      output_.flush(sync_policy_);
+      last_sync_ = Clock::now();
+    }
+    return;
+  }
+  if(!current_chunk_->records->empty() &&
+     Clock::now() - current_chunk_->creation_time >= max_chunk_age_)
+  {
+    submitChunk();
+  }
+}
+
+void MCAPFileWriter::submitChunk()
+{
+  if(!current_chunk_ || current_chunk_->records->empty())
+  {
+    return;
+  }
+  ++statistics_.chunkCount;
+
+  if(workers_.empty())
+  {
+    compress(*current_chunk_);
+    writeChunk(*current_chunk_);
+    return;
+  }
+  {
+    std::unique_lock lk(mutex_);
+    compress_queue_.push_back(current_chunk_.get());
+    write_queue_.push_back(std::move(current_chunk_));
+    cv_.notify_all();
+    // blocks only if all the other chunks are still in flight
+    cv_.wait(lk, [this] { return !free_chunks_.empty(); });
+    current_chunk_ = std::move(free_chunks_.back());
+    free_chunks_.pop_back();
+  }
+}
+
+void MCAPFileWriter::compress(Chunk& chunk) const
+{
+  const uint64_t uncompressed_size = chunk.records->size();
+  chunk.compression.clear();
+  chunk.compressed_size = uncompressed_size;
+  chunk.compressed_data = chunk.records->data();
+
+  if(options_.forceCompression || uncompressed_size >= kMinCompressionSize)
+  {
+    chunk.records->end();
+    const uint64_t compressed_size = chunk.records->compressedSize();
+    // Only use the compressed data if it is materially smaller than the uncompressed data
+    const double ratio = double(uncompressed_size) / double(compressed_size);
+    if(options_.forceCompression || ratio >= kMinCompressionRatio)
+    {
+      chunk.compression = CompressionName(options_.compression);
+      chunk.compressed_size = compressed_size;
+      chunk.compressed_data = chunk.records->compressedData();
+    }
+  }
+}
+
+void MCAPFileWriter::writeChunk(Chunk& chunk)
+{
+  const uint64_t uncompressed_size = chunk.records->size();
+  const uint64_t chunk_start_offset = output_.size();
+  mcap::McapWriter::write(output_, mcap::Chunk{ chunk.start_time, chunk.end_time,
+                                                uncompressed_size, chunk.records->crc(),
+                                                chunk.compression, chunk.compressed_size,
+                                                chunk.compressed_data });
+  const uint64_t chunk_length = output_.size() - chunk_start_offset;
+
+  mcap::ChunkIndex chunk_index;
+  const uint64_t message_index_offset = output_.size();
+  if(!options_.noMessageIndex)
+  {
+    for(auto& [channel_id, message_index] : chunk.message_index)
+    {
+      // entries are kept for every channel seen by this chunk object, skip the empty ones.
+      if(!message_index.records.empty())
+      {
+        chunk_index.messageIndexOffsets.emplace(channel_id, output_.size());
+        mcap::McapWriter::write(output_, message_index);
+        message_index.records.clear();
+      }
+    }
+  }
+  if(!options_.noChunkIndex)
+  {
+    chunk_index.messageStartTime = chunk.start_time;
+    chunk_index.messageEndTime = chunk.end_time;
+    chunk_index.chunkStartOffset = chunk_start_offset;
+    chunk_index.chunkLength = chunk_length;
+    chunk_index.messageIndexLength = output_.size() - message_index_offset;
+    chunk_index.compression = chunk.compression;
+    chunk_index.compressedSize = chunk.compressed_size;
+    chunk_index.uncompressedSize = uncompressed_size;
+    chunk_index_.push_back(std::move(chunk_index));
+  }
+
+  file_size_ = output_.size();
+  output_.flush(sync_policy_);
+
+  // ready to be filled again
+  chunk.records->clear();
+  chunk.start_time = mcap::MaxTime;
+  chunk.end_time = 0;
+  chunk.compressed = false;
+}
+
+void MCAPFileWriter::compressLoop()
+{
+  while(true)
+  {
+    Chunk* chunk = nullptr;
+    {
+      std::unique_lock lk(mutex_);
+      cv_.wait(lk, [this] { return stop_ || !compress_queue_.empty(); });
+      if(compress_queue_.empty())
+      {
+        return;
+      }
+      chunk = compress_queue_.front();
+      compress_queue_.pop_front();
+    }
+    compress(*chunk);
+    {
+      std::scoped_lock lk(mutex_);
+      chunk->compressed = true;
+    }
+    cv_.notify_all();
+  }
+}
+
+void MCAPFileWriter::writeLoop()
+{
+  while(true)
+  {
+    Chunk* chunk = nullptr;
+    {
+      std::unique_lock lk(mutex_);
+      // the chunks must be written in order
+      cv_.wait(lk, [this] {
+        return (stop_ && write_queue_.empty()) ||
+               (!write_queue_.empty() && write_queue_.front()->compressed);
+      });
+      if(write_queue_.empty())
+      {
+        return;
+      }
+      chunk = write_queue_.front().get();
+    }
+    writeChunk(*chunk);
+    {
+      std::scoped_lock lk(mutex_);
+      free_chunks_.push_back(std::move(write_queue_.front()));
+      write_queue_.pop_front();
+    }
+    cv_.notify_all();
+  }
+}
+
+void MCAPFileWriter::close()
+{
+  if(!opened_)
+  {
+    return;
+  }
+  submitChunk();
+  {
+    std::scoped_lock lk(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for(auto& worker : workers_)
+  {
+    worker.join();
+  }
+  workers_.clear();
+  if(writer_thread_.joinable())
+  {
+    writer_thread_.join();
+  }
+
+  // From here, same as mcap::McapWriter::close()
+  mcap::McapWriter::write(output_, mcap::DataEnd{ output_.crc() });
+  if(!options_.noSummaryCRC)
+  {
+    output_.crcEnabled = true;
+    output_.resetCrc();
+  }
+
+  mcap::ByteOffset summary_start = 0;
+  mcap::ByteOffset summary_offset_start = 0;
+
+  if(!options_.noSummary)
+  {
+    summary_start = output_.size();
+
+    const mcap::ByteOffset schema_start = output_.size();
+    if(!options_.noRepeatedSchemas)
+    {
+      for(const auto& schema : schemas_)
+      {
+        mcap::McapWriter::write(output_, schema);
+      }
+    }
+    const mcap::ByteOffset channel_start = output_.size();
+    if(!options_.noRepeatedChannels)
+    {
+      for(const auto& channel : channels_)
+      {
+        mcap::McapWriter::write(output_, channel);
+      }
+    }
+    const mcap::ByteOffset statistics_start = output_.size();
+    if(!options_.noStatistics)
+    {
+      mcap::McapWriter::write(output_, statistics_);
+    }
+    const mcap::ByteOffset chunk_index_start = output_.size();
+    if(!options_.noChunkIndex)
+    {
+      for(const auto& chunk_index : chunk_index_)
+      {
+        mcap::McapWriter::write(output_, chunk_index);
+      }
+    }
+    const mcap::ByteOffset chunk_index_end = output_.size();
+
+    if(!options_.noSummaryOffsets)
+    {
+      summary_offset_start = output_.size();
+      if(!options_.noRepeatedSchemas && !schemas_.empty())
+      {
+        mcap::McapWriter::write(output_, mcap::SummaryOffset{ mcap::OpCode::Schema, schema_start,
+                                                              channel_start - schema_start });
+      }
+      if(!options_.noRepeatedChannels && !channels_.empty())
+      {
+        mcap::McapWriter::write(output_,
+                                mcap::SummaryOffset{ mcap::OpCode::Channel, channel_start,
+                                                     statistics_start - channel_start });
+      }
+      if(!options_.noStatistics)
+      {
+        mcap::McapWriter::write(output_,
+                                mcap::SummaryOffset{ mcap::OpCode::Statistics, statistics_start,
+                                                     chunk_index_start - statistics_start });
+      }
+      if(!options_.noChunkIndex && !chunk_index_.empty())
+      {
+        mcap::McapWriter::write(output_,
+                                mcap::SummaryOffset{ mcap::OpCode::ChunkIndex, chunk_index_start,
+                                                     chunk_index_end - chunk_index_start });
+      }
+    }
+    else if(summary_start == output_.size())
+    {
+      // No summary records were written
+      summary_start = 0;
+    }
+  }
+
+  mcap::McapWriter::write(output_, mcap::Footer{ summary_start, summary_offset_start },
+                          !options_.noSummaryCRC);
+  mcap::McapWriter::writeMagic(output_);
+  output_.flush(sync_policy_);
+  output_.end();
+  opened_ = false;
+}
+
+}  // namespace DataTamer
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "data_tamer/sinks/mcap_sink.hpp"
+
+#include <mcap/writer.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <condition_variable>
+#include <deque>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace DataTamer
+{
+
+/**
+ * @brief MCAPFileWriter writes an MCAP file, like mcap::McapWriter, but the chunks
+ * can be compressed by a pool of threads, instead of the thread calling write().
+ *
+ * The records are serialized into the current chunk. When it is full, it is handed
+ * to the compression workers; a writer thread saves the compressed chunks into the file,
+ * in the same order they were created, together with their message indexes.
+ * write() blocks only if all the chunks in flight are still being compressed.
+ *
+ * With zero compression threads, chunks are compressed and written by write(),
+ * same as mcap::McapWriter.
+ *
+ * A chunk is also closed when it is older than MCAPSinkOptions::max_chunk_age;
+ * after writing it, the file is flushed according to MCAPSinkOptions::sync_policy.
+ *
+ * Attachments and metadata are not supported.
+ */
+class MCAPFileWriter
+{
+public:
+  /**
+   * @brief Throws std::runtime_error if the file can't be opened
+   *
+   * @param options       format of the file
+   * @param sink_options  used only for compression_threads, max_chunk_age and sync_policy
+   */
+  MCAPFileWriter(std::string const& filepath, const mcap::McapWriterOptions& options,
+                 const MCAPSinkOptions& sink_options);
+
+  ~MCAPFileWriter();
+
+  MCAPFileWriter(const MCAPFileWriter&) = delete;
+  MCAPFileWriter& operator=(const MCAPFileWriter&) = delete;
+
+  /// Assigns the id of the schema
+  void addSchema(mcap::Schema& schema);
+
+  /// Assigns the id of the channel
+  void addChannel(mcap::Channel& channel);
+
+  /// Register the schemas and channels of another writer, with the same IDs.
+  /// Must be called before addSchema() and addChannel().
+  void copyChannels(const MCAPFileWriter& other);
+
+  /// A contiguous block of bytes, part of the data of a message
+  struct DataView
+  {
+    const void* data = nullptr;
+    uint64_t size = 0;
+  };
+
+  void write(const mcap::Message& message);
+
+  /// Same as write(message), but the data of the message is the concatenation of `parts`,
+  /// copied directly into the chunk. message.data and message.dataSize are ignored.
+  void write(const mcap::Message& message, std::initializer_list<DataView> parts);
+
+  /// Close the current chunk if it is older than max_chunk_age, or synchronize the
+  /// file when chunks are not used. Called periodically, if nothing is written.
+  void closeOldChunk();
+
+  /// Bytes written into the file so far. Chunks not written yet are not included.
+  [[nodiscard]] uint64_t fileSize() const { return file_size_; }
+
+  /// Wait for all the chunks to be written, then write the summary and close the file.
+  void close();
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  // same as mcap::FileWriter, but it can be flushed and synchronized
+  class OutputFile final : public mcap::IWritable
+  {
+  public:
+    ~OutputFile() override;
+    bool open(std::string const& filepath);
+    void handleWrite(const std::byte* data, uint64_t size) override;
+    void end() override;
+    uint64_t size() const override { return size_; }
+    void flush(MCAPSinkOptions::SyncPolicy policy);
+
+  private:
+    std::FILE* file_ = nullptr;
+    uint64_t size_ = 0;
+  };
+
+  struct Chunk
+  {
+    // uncompressed records; it may also compress them
+    std::unique_ptr<mcap::IChunkWriter> records;
+    mcap::Timestamp start_time = mcap::MaxTime;
+    mcap::Timestamp end_time = 0;
+    // when the first record was written
+    Clock::time_point creation_time;
+    // the key is the channel ID
+    std::unordered_map<mcap::ChannelId, mcap::MessageIndex> message_index;
+
+    // result of compress()
+    bool compressed = false;
+    std::string compression;
+    uint64_t compressed_size = 0;
+    const std::byte* compressed_data = nullptr;
+  };
+
+  mcap::McapWriterOptions options_;
+  Clock::duration max_chunk_age_ = {};
+  MCAPSinkOptions::SyncPolicy sync_policy_ = MCAPSinkOptions::SyncPolicy::NONE;
+  // used when there are no chunks
+  Clock::time_point last_sync_;
+  OutputFile output_;
+  bool opened_ = false;
+  std::atomic_uint64_t file_size_ = 0;
+
+  std::vector<mcap::Schema> schemas_;
+  std::vector<mcap::Channel> channels_;
+  std::set<mcap::SchemaId> written_schemas_;
+  mcap::Statistics statistics_ = {};
+  // accessed only by the writer thread, until it is joined
+  std::vector<mcap::ChunkIndex> chunk_index_;
+
+  // chunk being filled by write()
+  std::unique_ptr<Chunk> current_chunk_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::unique_ptr<Chunk>> free_chunks_;
+  std::deque<Chunk*> compress_queue_;
+  // chunks in flight, in order of creation
+  std::deque<std::unique_ptr<Chunk>> write_queue_;
+  bool stop_ = false;
+  std::vector<std::thread> workers_;
+  std::thread writer_thread_;
+
+  std::unique_ptr<Chunk> createChunk() const;
+  void submitChunk();
+  void compress(Chunk& chunk) const;
+  void writeChunk(Chunk& chunk);
+  void compressLoop();
+  void writeLoop();
+};
+
+}  // namespace DataTamer
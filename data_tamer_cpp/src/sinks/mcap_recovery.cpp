@@ -0,0 +1,501 @@
+#include "data_tamer/sinks/mcap_sink.hpp"
+
+#include <mcap/crc32.hpp>
+#include <mcap/reader.hpp>
+#include <mcap/writer.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace DataTamer
+{
+
+namespace
+{
+
+struct FileCloser
+{
+  void operator()(std::FILE* file) const { std::fclose(file); }
+};
+using FilePtr = std::unique_ptr<std::FILE, FileCloser>;
+
+FilePtr OpenFile(std::string const& filepath, const char* mode)
+{
+  FilePtr file(std::fopen(filepath.c_str(), mode));
+  if(!file)
+  {
+    throw std::runtime_error("MCAP recovery: can't open the file " + filepath);
+  }
+  return file;
+}
+
+// Schemas, channels and messages found in a part of the file
+struct Content
+{
+  std::map<mcap::SchemaId, mcap::Schema> schemas;
+  std::map<mcap::ChannelId, mcap::Channel> channels;
+  std::unordered_map<mcap::ChannelId, uint64_t> message_counts;
+  uint64_t messages = 0;
+  mcap::Timestamp start_time = mcap::MaxTime;
+  mcap::Timestamp end_time = 0;
+
+  // returns false if the record is not valid
+  bool add(const mcap::Record& record)
+  {
+    switch(record.opcode)
+    {
+      case mcap::OpCode::Schema: {
+        mcap::Schema schema;
+        if(!mcap::McapReader::ParseSchema(record, &schema).ok())
+        {
+          return false;
+        }
+        schemas.emplace(schema.id, schema);
+      }
+      break;
+      case mcap::OpCode::Channel: {
+        mcap::Channel channel;
+        if(!mcap::McapReader::ParseChannel(record, &channel).ok())
+        {
+          return false;
+        }
+        channels.emplace(channel.id, channel);
+      }
+      break;
+      case mcap::OpCode::Message: {
+        mcap::Message message;
+        if(!mcap::McapReader::ParseMessage(record, &message).ok())
+        {
+          return false;
+        }
+        message_counts[message.channelId]++;
+        messages++;
+        start_time = std::min(start_time, message.logTime);
+        end_time = std::max(end_time, message.logTime);
+      }
+      break;
+      default:
+        break;
+    }
+    return true;
+  }
+
+  void merge(const Content& other)
+  {
+    schemas.insert(other.schemas.begin(), other.schemas.end());
+    channels.insert(other.channels.begin(), other.channels.end());
+    for(const auto& [id, count] : other.message_counts)
+    {
+      message_counts[id] += count;
+    }
+    messages += other.messages;
+    start_time = std::min(start_time, other.start_time);
+    end_time = std::max(end_time, other.end_time);
+  }
+};
+
+struct ChunkEntry
+{
+  // found by the sequential scan
+  uint64_t offset = 0;
+  uint64_t length = 0;
+  std::unordered_map<mcap::ChannelId, mcap::ByteOffset> message_index_offsets;
+  uint64_t message_index_length = 0;
+
+  // filled by the parallel scan
+  bool valid = false;
+  mcap::ChunkIndex index;
+  Content content;
+};
+
+// Result of the sequential scan of the records in the data section
+struct Scan
+{
+  std::vector<ChunkEntry> chunks;
+  // records outside the chunks
+  Content content;
+  uint64_t last_content_offset = 0;
+  // end of the last complete record
+  uint64_t valid_end = 0;
+};
+
+// Read only the header of the chunks, that are decompressed later in parallel
+Scan ScanRecords(std::string const& filepath, uint64_t end_offset)
+{
+  auto file = OpenFile(filepath, "rb");
+  mcap::FileReader reader(file.get());
+  end_offset = std::min(end_offset, reader.size());
+
+  std::byte* data = nullptr;
+  if(reader.read(&data, 0, sizeof(mcap::Magic)) != sizeof(mcap::Magic) ||
+     std::memcmp(data, mcap::Magic, sizeof(mcap::Magic)) != 0)
+  {
+    throw std::runtime_error("MCAP recovery: not a MCAP file: " + filepath);
+  }
+
+  Scan scan;
+  uint64_t offset = sizeof(mcap::Magic);
+  scan.valid_end = offset;
+  bool after_chunk = false;
+  bool done = false;
+
+  while(!done && offset + 9 <= end_offset)
+  {
+    reader.read(&data, offset, 9);
+    const auto opcode = mcap::OpCode(data[0]);
+    uint64_t length = 0;
+    std::memcpy(&length, data + 1, sizeof(length));
+    if(length > end_offset - offset - 9)
+    {
+      // truncated
+      break;
+    }
+    const uint64_t record_size = 9 + length;
+
+    switch(opcode)
+    {
+      case mcap::OpCode::Header:
+      case mcap::OpCode::Attachment:
+      case mcap::OpCode::Metadata:
+        break;
+
+      case mcap::OpCode::Chunk: {
+        ChunkEntry entry;
+        entry.offset = offset;
+        entry.length = record_size;
+        scan.chunks.push_back(std::move(entry));
+      }
+      break;
+
+      case mcap::OpCode::MessageIndex: {
+        if(after_chunk && length >= 2 && reader.read(&data, offset + 9, 2) == 2)
+        {
+          mcap::ChannelId channel_id = 0;
+          std::memcpy(&channel_id, data, sizeof(channel_id));
+          auto& chunk = scan.chunks.back();
+          chunk.message_index_offsets[channel_id] = offset;
+          chunk.message_index_length += record_size;
+        }
+      }
+      break;
+
+      case mcap::OpCode::Schema:
+      case mcap::OpCode::Channel:
+      case mcap::OpCode::Message: {
+        mcap::Record record;
+        if(!mcap::McapReader::ReadRecord(reader, offset, &record).ok() ||
+           !scan.content.add(record))
+        {
+          done = true;
+          continue;
+        }
+        scan.last_content_offset = offset;
+      }
+      break;
+
+      // DataEnd: the summary follows, it will be rebuilt
+      // Anything else is not expected in the data section
+      default:
+        done = true;
+        continue;
+    }
+    after_chunk = (opcode == mcap::OpCode::Chunk || opcode == mcap::OpCode::MessageIndex);
+    offset += record_size;
+    scan.valid_end = offset;
+  }
+  return scan;
+}
+
+// Decompress the chunk, verify its CRC and read its content
+void ReadChunk(mcap::IReadable& file, ChunkEntry& entry)
+{
+  mcap::Record record;
+  mcap::Chunk chunk;
+  if(!mcap::McapReader::ReadRecord(file, entry.offset, &record).ok() ||
+     !mcap::McapReader::ParseChunk(record, &chunk).ok())
+  {
+    return;
+  }
+  const auto compression = mcap::McapReader::ParseCompression(chunk.compression);
+  if(!compression)
+  {
+    return;
+  }
+
+  mcap::BufferReader uncompressed_reader;
+#ifndef MCAP_COMPRESSION_NO_LZ4
+  mcap::LZ4Reader lz4_reader;
+#endif
+#ifndef MCAP_COMPRESSION_NO_ZSTD
+  mcap::ZStdReader zstd_reader;
+#endif
+  mcap::ICompressedReader* reader = nullptr;
+  switch(*compression)
+  {
+    case mcap::Compression::None:
+      reader = &uncompressed_reader;
+      break;
+#ifndef MCAP_COMPRESSION_NO_LZ4
+    case mcap::Compression::Lz4:
+      reader = &lz4_reader;
+      break;
+#endif
+#ifndef MCAP_COMPRESSION_NO_ZSTD
+    case mcap::Compression::Zstd:
+      reader = &zstd_reader;
+      break;
+#endif
+    default:
+      throw std::runtime_error("MCAP recovery: the compression of the file is not available");
+  }
+
+  reader->reset(chunk.records, chunk.compressedSize, chunk.uncompressedSize);
+  std::byte* data = nullptr;
+  if(!reader->status().ok() ||
+     reader->read(&data, 0, chunk.uncompressedSize) != chunk.uncompressedSize)
+  {
+    return;
+  }
+  if(chunk.uncompressedCrc != 0)
+  {
+    const uint32_t crc = mcap::internal::crc32Final(mcap::internal::crc32Update(
+        mcap::internal::CRC32_INIT, data, chunk.uncompressedSize));
+    if(crc != chunk.uncompressedCrc)
+    {
+      return;
+    }
+  }
+
+  mcap::RecordReader records(*reader, 0, chunk.uncompressedSize);
+  while(auto inner_record = records.next())
+  {
+    if(!entry.content.add(*inner_record))
+    {
+      return;
+    }
+  }
+  if(!records.status().ok())
+  {
+    return;
+  }
+
+  // an index is missing, if the file was truncated after the chunk
+  for(const auto& [channel_id, count] : entry.content.message_counts)
+  {
+    if(entry.message_index_offsets.count(channel_id) == 0)
+    {
+      entry.message_index_offsets.clear();
+      entry.message_index_length = 0;
+      break;
+    }
+  }
+
+  auto& index = entry.index;
+  index.messageStartTime = chunk.messageStartTime;
+  index.messageEndTime = chunk.messageEndTime;
+  index.chunkStartOffset = entry.offset;
+  index.chunkLength = entry.length;
+  index.messageIndexOffsets = entry.message_index_offsets;
+  index.messageIndexLength = entry.message_index_length;
+  index.compression = chunk.compression;
+  index.compressedSize = chunk.compressedSize;
+  index.uncompressedSize = chunk.uncompressedSize;
+  entry.valid = true;
+}
+
+void ReadChunks(std::string const& filepath, std::vector<ChunkEntry>& chunks, size_t threads)
+{
+  std::atomic_size_t next_chunk = 0;
+  std::exception_ptr error;
+  std::mutex error_mutex;
+
+  auto worker = [&]() {
+    try
+    {
+      auto file = OpenFile(filepath, "rb");
+      mcap::FileReader reader(file.get());
+      for(size_t i = next_chunk++; i < chunks.size(); i = next_chunk++)
+      {
+        ReadChunk(reader, chunks[i]);
+      }
+    }
+    catch(...)
+    {
+      std::scoped_lock lk(error_mutex);
+      error = std::current_exception();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for(size_t i = 1; i < threads; i++)
+  {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for(auto& thread : workers)
+  {
+    thread.join();
+  }
+  if(error)
+  {
+    std::rethrow_exception(error);
+  }
+}
+
+// DataEnd, summary, footer and magic, as written by mcap::McapWriter::close()
+void WriteSummary(mcap::IWritable& output, uint64_t base_offset, const Content& content,
+                  const std::vector<mcap::ChunkIndex>& chunk_indexes)
+{
+  // offset in the file
+  auto position = [&]() { return base_offset + output.size(); };
+
+  mcap::McapWriter::write(output, mcap::DataEnd{ 0 });
+  output.crcEnabled = true;
+  output.resetCrc();
+
+  const uint64_t schema_start = position();
+  for(const auto& [id, schema] : content.schemas)
+  {
+    mcap::McapWriter::write(output, schema);
+  }
+  const uint64_t channel_start = position();
+  for(const auto& [id, channel] : content.channels)
+  {
+    mcap::McapWriter::write(output, channel);
+  }
+  const uint64_t statistics_start = position();
+  mcap::Statistics statistics = {};
+  statistics.messageCount = content.messages;
+  statistics.schemaCount = uint16_t(content.schemas.size());
+  statistics.channelCount = uint32_t(content.channels.size());
+  statistics.chunkCount = uint32_t(chunk_indexes.size());
+  if(content.messages > 0)
+  {
+    statistics.messageStartTime = content.start_time;
+    statistics.messageEndTime = content.end_time;
+  }
+  statistics.channelMessageCounts = content.message_counts;
+  mcap::McapWriter::write(output, statistics);
+
+  const uint64_t chunk_index_start = position();
+  for(const auto& index : chunk_indexes)
+  {
+    mcap::McapWriter::write(output, index);
+  }
+  const uint64_t summary_offset_start = position();
+
+  if(!content.schemas.empty())
+  {
+    mcap::McapWriter::write(output, mcap::SummaryOffset{ mcap::OpCode::Schema, schema_start,
+                                                         channel_start - schema_start });
+  }
+  if(!content.channels.empty())
+  {
+    mcap::McapWriter::write(output, mcap::SummaryOffset{ mcap::OpCode::Channel, channel_start,
+                                                         statistics_start - channel_start });
+  }
+  mcap::McapWriter::write(output,
+                          mcap::SummaryOffset{ mcap::OpCode::Statistics, statistics_start,
+                                               chunk_index_start - statistics_start });
+  if(!chunk_indexes.empty())
+  {
+    mcap::McapWriter::write(output,
+                            mcap::SummaryOffset{ mcap::OpCode::ChunkIndex, chunk_index_start,
+                                                 summary_offset_start - chunk_index_start });
+  }
+  mcap::McapWriter::write(output, mcap::Footer{ schema_start, summary_offset_start }, true);
+  mcap::McapWriter::writeMagic(output);
+}
+
+}  // namespace
+
+MCAPRecoveryStats MCAPSink::recoverFile(std::string const& filepath,
+                                        std::string const& output_filepath, size_t threads)
+{
+  if(threads == 0)
+  {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  const uint64_t file_size = std::filesystem::file_size(filepath);
+
+  Scan scan = ScanRecords(filepath, file_size);
+  ReadChunks(filepath, scan.chunks, threads);
+
+  // the data after the first corrupted chunk is discarded
+  auto first_invalid = std::find_if(scan.chunks.begin(), scan.chunks.end(),
+                                    [](const ChunkEntry& chunk) { return !chunk.valid; });
+  if(first_invalid != scan.chunks.end())
+  {
+    const uint64_t cut = first_invalid->offset;
+    scan.chunks.erase(first_invalid, scan.chunks.end());
+    if(scan.last_content_offset > cut)
+    {
+      // there were records outside the chunks after the cut. Scan them again
+      Scan partial = ScanRecords(filepath, cut);
+      scan.content = std::move(partial.content);
+    }
+    scan.valid_end = cut;
+  }
+
+  Content content = scan.content;
+  std::vector<mcap::ChunkIndex> chunk_indexes;
+  for(const auto& chunk : scan.chunks)
+  {
+    content.merge(chunk.content);
+    chunk_indexes.push_back(chunk.index);
+  }
+
+  mcap::BufferWriter summary;
+  WriteSummary(summary, scan.valid_end, content, chunk_indexes);
+
+  if(output_filepath.empty() || output_filepath == filepath)
+  {
+    std::filesystem::resize_file(filepath, scan.valid_end);
+    auto output = OpenFile(filepath, "ab");
+    std::fwrite(summary.data(), 1, summary.size(), output.get());
+    if(std::fflush(output.get()) != 0)
+    {
+      throw std::runtime_error("MCAP recovery: failed to write " + filepath);
+    }
+  }
+  else
+  {
+    auto input = OpenFile(filepath, "rb");
+    auto output = OpenFile(output_filepath, "wb");
+    std::vector<char> buffer(1024 * 1024);
+    uint64_t remaining = scan.valid_end;
+    while(remaining > 0)
+    {
+      const size_t size = size_t(std::min<uint64_t>(remaining, buffer.size()));
+      if(std::fread(buffer.data(), 1, size, input.get()) != size)
+      {
+        throw std::runtime_error("MCAP recovery: failed to read " + filepath);
+      }
+      std::fwrite(buffer.data(), 1, size, output.get());
+      remaining -= size;
+    }
+    std::fwrite(summary.data(), 1, summary.size(), output.get());
+    if(std::fflush(output.get()) != 0)
+    {
+      throw std::runtime_error("MCAP recovery: failed to write " + output_filepath);
+    }
+  }
+
+  MCAPRecoveryStats stats;
+  stats.chunks = scan.chunks.size();
+  stats.messages = content.messages;
+  stats.discarded_bytes = file_size - scan.valid_end;
+  return stats;
+}
+
+}  // namespace DataTamer
@@ -1,7 +1,7 @@
 #include "data_tamer/sinks/mcap_sink.hpp"
-#include "data_tamer/contrib/SerializeMe.hpp"
 
 #include <chrono>
+#include <filesystem>
 #include <sstream>
 #include <mutex>
 #include <string>
@@ -13,45 +13,115 @@
 #include <mcap/writer.hpp>
 #include <mcap/reader.hpp>
 
-#if defined __has_include && __has_include("boost/container/small_vector.hpp")
-#include <boost/container/small_vector.hpp>
+// after MCAP_IMPLEMENTATION
+#include "mcap_file_writer.hpp"
 
-namespace SerializeMe
+namespace DataTamer
 {
-template <size_t N>
-void SerializeIntoBuffer(SpanBytes& buffer,
-                         boost::container::small_vector<uint8_t, N> const& value)
+
+static constexpr char const* kDataTamer = "data_tamer";
+
+static mcap::McapWriterOptions ToWriterOptions(const MCAPSinkOptions& opt)
 {
-  SerializeMe::SerializeIntoBuffer(buffer, uint32_t(value.size()));
-  std::memcpy(buffer.data(), value.data(), value.size());
-  buffer.trimFront(value.size());
+  mcap::McapWriterOptions options(kDataTamer);
+  switch(opt.compression)
+  {
+    case MCAPSinkOptions::Compression::NONE:
+      options.compression = mcap::Compression::None;
+      break;
+    case MCAPSinkOptions::Compression::LZ4:
+      options.compression = mcap::Compression::Lz4;
+      break;
+    case MCAPSinkOptions::Compression::ZSTD:
+      options.compression = mcap::Compression::Zstd;
+      break;
+  }
+  switch(opt.compression_level)
+  {
+    case MCAPSinkOptions::CompressionLevel::FASTEST:
+      options.compressionLevel = mcap::CompressionLevel::Fastest;
+      break;
+    case MCAPSinkOptions::CompressionLevel::FAST:
+      options.compressionLevel = mcap::CompressionLevel::Fast;
+      break;
+    case MCAPSinkOptions::CompressionLevel::DEFAULT:
+      options.compressionLevel = mcap::CompressionLevel::Default;
+      break;
+    case MCAPSinkOptions::CompressionLevel::SLOW:
+      options.compressionLevel = mcap::CompressionLevel::Slow;
+      break;
+    case MCAPSinkOptions::CompressionLevel::SLOWEST:
+      options.compressionLevel = mcap::CompressionLevel::Slowest;
+      break;
+  }
+  options.forceCompression = opt.force_compression;
+  options.chunkSize = opt.chunk_size;
+  options.noChunking = opt.no_chunking;
+  options.noChunkCRC = opt.no_chunk_crc;
+  options.enableDataCRC = opt.enable_data_crc;
+  options.noSummaryCRC = opt.no_summary_crc;
+  options.noMessageIndex = opt.no_message_index;
+  options.noSummary = opt.no_summary;
+  options.noChunkIndex = opt.no_chunk_index;
+  options.noStatistics = opt.no_statistics;
+  options.noSummaryOffsets = opt.no_summary_offsets;
+  options.noRepeatedSchemas = opt.no_repeated_schemas;
+  options.noRepeatedChannels = opt.no_repeated_channels;
+  return options;
 }
-}  // end namespace SerializeMe
 
-#endif
+MCAPSink::MCAPSink(const std::string& filepath, bool do_compression)
+  : MCAPSink(filepath, MCAPSinkOptions::FromCompressionFlag(do_compression))
+{}
 
-namespace DataTamer
+MCAPSink::MCAPSink(const std::string& filepath, const MCAPSinkOptions& options)
+  : filepath_(filepath), options_(options), original_filepath_(filepath)
 {
+  openFile(filepath_);
+}
 
-static constexpr char const* kDataTamer = "data_tamer";
+bool MCAPSink::isCompressionAvailable(MCAPSinkOptions::Compression compression)
+{
+  switch(compression)
+  {
+    case MCAPSinkOptions::Compression::NONE:
+      return true;
+    case MCAPSinkOptions::Compression::LZ4:
+#ifdef MCAP_COMPRESSION_NO_LZ4
+      return false;
+#else
+      return true;
+#endif
+    case MCAPSinkOptions::Compression::ZSTD:
+#ifdef MCAP_COMPRESSION_NO_ZSTD
+      return false;
+#else
+      return true;
+#endif
+  }
+  return false;
+}
 
-MCAPSink::MCAPSink(const std::string& filepath, bool do_compression)
-  : filepath_(filepath), compression_(do_compression), original_filepath_(filepath)
+MCAPSinkOptions MCAPSink::options() const
 {
-  openFile(filepath_);
+  return options_;
+}
+
+uint64_t MCAPSink::failedFileResets() const
+{
+  return failed_file_resets_;
 }
 
 void DataTamer::MCAPSink::openFile(std::string const& filepath)
 {
   std::scoped_lock lk(mutex_);
-  writer_ = std::make_unique<mcap::McapWriter>();
-  mcap::McapWriterOptions options(kDataTamer);
-  options.compression = compression_ ? mcap::Compression::Zstd : mcap::Compression::None;
-  auto status = writer_->open(filepath, options);
-  if(!status.ok())
+  if(!isCompressionAvailable(options_.compression))
   {
-    throw std::runtime_error("Failed to open MCAP file for writing");
+    throw std::runtime_error("MCAPSink: the requested compression is not available");
   }
+  // close the previous file before creating the new one, that might have the same name
+  writer_.reset();
+  writer_ = std::make_unique<MCAPFileWriter>(filepath, ToWriterOptions(options_), options_);
   start_time_ = std::chrono::system_clock::now();
   // clean up, in case this was opened a second time
   hash_to_channel_id_.clear();
@@ -61,6 +131,16 @@ MCAPSink::~MCAPSink()
 {
   stopThread();
   std::scoped_lock lk(mutex_);
+  {
+    std::scoped_lock rotation_lk(rotation_mutex_);
+    discardNextFile();
+    rotation_stop_ = true;
+  }
+  rotation_cv_.notify_all();
+  if(rotation_thread_.joinable())
+  {
+    rotation_thread_.join();
+  }
 }
 
 void MCAPSink::addChannel(std::string const& channel_name, Schema const& schema)
@@ -96,15 +176,42 @@ bool MCAPSink::storeSnapshot(const Snapshot& snapshot)
   {
     return false;
   }
-  // the payload must contain both the ActiveMask and the other data
-  thread_local std::vector<uint8_t> merged_payload;
-  const auto size_mask = snapshot.active_mask.size();
-  const auto size_data = snapshot.payload.size();
+  // before writing, to never leave a file without messages
+  checkFileReset();
+  writeSnapshot(snapshot);
+  return true;
+}
 
-  merged_payload.resize(size_mask + size_data + sizeof(uint32_t) * 2);
-  SerializeMe::SpanBytes buffer(merged_payload);
-  SerializeMe::SerializeIntoBuffer(buffer, snapshot.active_mask);
-  SerializeMe::SerializeIntoBuffer(buffer, snapshot.payload);
+bool MCAPSink::storeSnapshots(SnapshotsSpan snapshots)
+{
+  std::scoped_lock lk(mutex_);
+  if(forced_stop_recording_)
+  {
+    return false;
+  }
+  checkFileReset();
+  for(size_t i = 0; i < snapshots.size(); i++)
+  {
+    writeSnapshot(*snapshots.data()[i]);
+  }
+  return true;
+}
+
+void MCAPSink::onIdle()
+{
+  std::scoped_lock lk(mutex_);
+  if(writer_)
+  {
+    writer_->closeOldChunk();
+  }
+}
+
+void MCAPSink::writeSnapshot(const Snapshot& snapshot)
+{
+  // the payload must contain both the ActiveMask and the other data,
+  // each one preceded by its size
+  const auto size_mask = uint32_t(snapshot.active_mask.size());
+  const auto size_data = uint32_t(snapshot.payload.size());
 
   // Write our message
   mcap::Message msg;
@@ -113,24 +220,185 @@ bool MCAPSink::storeSnapshot(const Snapshot& snapshot)
   // Timestamp requires nanosecond
   msg.logTime = mcap::Timestamp(snapshot.timestamp.count());
   msg.publishTime = msg.logTime;
-  msg.data = reinterpret_cast<std::byte const*>(merged_payload.data());  // NOLINT
-  msg.dataSize = merged_payload.size();
-  auto status = writer_->write(msg);
+  // copied directly into the chunk, without merging them first
+  writer_->write(msg, { { &size_mask, sizeof(uint32_t) },
+                        { snapshot.active_mask.data(), size_mask },
+                        { &size_data, sizeof(uint32_t) },
+                        { snapshot.payload.data(), size_data } });
+}
 
+void MCAPSink::checkFileReset()
+{
   // If reset_time_ is exceeded, we want to overwrite the current file.
   // Better than filling the disk, if you forgot to stop the application.
+  const bool use_time = reset_time_ != std::chrono::seconds(0);
+  const bool use_size = reset_size_ > 0;
+  if(!writer_ || (!use_time && !use_size))
+  {
+    return;
+  }
   auto const now = std::chrono::system_clock::now();
-  if(reset_time_ != std::chrono::seconds(0) && now - start_time_ > reset_time_)
+  auto const elapsed = now - start_time_;
+  auto const size = writer_->fileSize();
+
+  std::scoped_lock lk(rotation_mutex_);
+  if(!next_requested_)
   {
-    if(create_file_on_reset_)
+    // open the next file in advance, when we are getting close to the limit
+    if((use_time && elapsed * 4 > reset_time_ * 3) || (use_size && size * 4 > reset_size_ * 3))
     {
-      // change the current filepath to the original with "_[# resets]"" appended
-      filepath_ = original_filepath_ + "_" + std::to_string(file_reset_counter_);
-      ++file_reset_counter_;
+      requestNextFile();
     }
-    restartRecordingImpl(filepath_, compression_, false);
+    return;
+  }
+  const bool expired = (use_time && elapsed > reset_time_) || (use_size && size >= reset_size_);
+  if(!expired || !next_writer_)
+  {
+    // if the next file is not ready yet, keep recording in the current one
+    return;
+  }
+
+  std::shared_ptr<MCAPFileWriter> prev_writer = std::move(writer_);
+  writer_ = std::move(next_writer_);
+  // same channel IDs, hash_to_channel_id_ is still valid
+  writer_->copyChannels(*prev_writer);
+  next_requested_ = false;
+  start_time_ = now;
+
+  const std::string prev_filepath = filepath_;
+  const std::string next_filepath = next_filepath_;
+  const bool overwrite = !create_file_on_reset_;
+  if(!overwrite)
+  {
+    filepath_ = next_filepath;
+  }
+  postRotationTask([this, prev_writer, prev_filepath, next_filepath, overwrite,
+                    max_files = retention_files_, max_bytes = retention_bytes_]() {
+    prev_writer->close();
+    if(overwrite)
+    {
+      std::error_code ec;
+      std::filesystem::remove(prev_filepath, ec);
+      std::filesystem::rename(next_filepath, prev_filepath, ec);
+    }
+    else
+    {
+      rotated_files_.push_back(prev_filepath);
+      applyRetention(max_files, max_bytes);
+    }
+  });
+}
+
+void MCAPSink::requestNextFile()
+{
+  next_requested_ = true;
+  std::string filepath = filepath_ + ".next";
+  if(create_file_on_reset_)
+  {
+    // change the current filepath to the original with "_[# resets]"" appended
+    filepath = original_filepath_ + "_" + std::to_string(file_reset_counter_);
+    ++file_reset_counter_;
+  }
+  postRotationTask([this, filepath, options = options_, generation = rotation_generation_]() {
+    std::unique_ptr<MCAPFileWriter> writer;
+    try
+    {
+      writer = std::make_unique<MCAPFileWriter>(filepath, ToWriterOptions(options), options);
+    }
+    catch(std::exception&)
+    {
+      // the recording continues in the current file, and the next call of
+      // checkFileReset will request the file again
+      failed_file_resets_++;
+      std::scoped_lock lk(rotation_mutex_);
+      if(generation == rotation_generation_)
+      {
+        next_requested_ = false;
+      }
+      return;
+    }
+    std::scoped_lock lk(rotation_mutex_);
+    if(generation != rotation_generation_)
+    {
+      writer.reset();
+      std::error_code ec;
+      std::filesystem::remove(filepath, ec);
+      return;
+    }
+    next_writer_ = std::move(writer);
+    next_filepath_ = filepath;
+  });
+}
+
+void MCAPSink::discardNextFile()
+{
+  rotation_generation_++;
+  next_requested_ = false;
+  if(next_writer_)
+  {
+    std::shared_ptr<MCAPFileWriter> writer = std::move(next_writer_);
+    postRotationTask([writer, filepath = next_filepath_]() {
+      writer->close();
+      std::error_code ec;
+      std::filesystem::remove(filepath, ec);
+    });
+  }
+}
+
+void MCAPSink::postRotationTask(std::function<void()> task)
+{
+  rotation_tasks_.push_back(std::move(task));
+  rotation_pending_++;
+  if(!rotation_thread_.joinable())
+  {
+    rotation_thread_ = std::thread(&MCAPSink::rotationLoop, this);
+  }
+  rotation_cv_.notify_all();
+}
+
+void MCAPSink::rotationLoop()
+{
+  std::unique_lock lk(rotation_mutex_);
+  while(true)
+  {
+    rotation_cv_.wait(lk, [this] { return rotation_stop_ || !rotation_tasks_.empty(); });
+    if(rotation_tasks_.empty())
+    {
+      return;
+    }
+    auto task = std::move(rotation_tasks_.front());
+    rotation_tasks_.pop_front();
+    lk.unlock();
+    task();
+    lk.lock();
+    rotation_pending_--;
+    rotation_cv_.notify_all();
+  }
+}
+
+void MCAPSink::waitRotationTasks()
+{
+  std::unique_lock lk(rotation_mutex_);
+  rotation_cv_.wait(lk, [this] { return rotation_pending_ == 0; });
+}
+
+void MCAPSink::applyRetention(size_t max_files, uint64_t max_bytes)
+{
+  uint64_t total_bytes = 0;
+  std::error_code ec;
+  for(const auto& file : rotated_files_)
+  {
+    const auto size = std::filesystem::file_size(file, ec);
+    total_bytes += ec ? 0 : size;
+  }
+  while(!rotated_files_.empty() && ((max_files > 0 && rotated_files_.size() > max_files) ||
+                                    (max_bytes > 0 && total_bytes > max_bytes)))
+  {
+    const auto size = std::filesystem::file_size(rotated_files_.front(), ec);
+    total_bytes -= ec ? 0 : size;
+    std::filesystem::remove(rotated_files_.front(), ec);
+    rotated_files_.pop_front();
   }
-  return true;
 }
 
 void MCAPSink::setMaxTimeBeforeReset(std::chrono::seconds reset_time)
@@ -138,36 +406,66 @@ void MCAPSink::setMaxTimeBeforeReset(std::chrono::seconds reset_time)
   reset_time_ = reset_time;
 }
 
+void MCAPSink::setMaxSizeBeforeReset(uint64_t max_bytes)
+{
+  reset_size_ = max_bytes;
+}
+
 void MCAPSink::setCreateNewFileOnReset(bool create_file_on_reset)
 {
   create_file_on_reset_ = create_file_on_reset;
 }
 
+void MCAPSink::setRetention(size_t max_files, uint64_t max_total_bytes)
+{
+  std::scoped_lock lk(mutex_);
+  retention_files_ = max_files;
+  retention_bytes_ = max_total_bytes;
+}
+
 void MCAPSink::stopRecording()
 {
   std::scoped_lock lk(mutex_);
   forced_stop_recording_ = true;
-  writer_->close();
-  writer_.reset();
+  {
+    std::scoped_lock rotation_lk(rotation_mutex_);
+    discardNextFile();
+  }
+  if(writer_)
+  {
+    writer_->close();
+    writer_.reset();
+  }
+  // the previous files are closed too, when this returns
+  waitRotationTasks();
 }
 
 void MCAPSink::restartRecording(const std::string& filepath, bool do_compression)
 {
-  restartRecordingImpl(filepath, do_compression, true);
+  restartRecordingImpl(filepath, MCAPSinkOptions::FromCompressionFlag(do_compression));
 }
 
-void MCAPSink::restartRecordingImpl(const std::string& filepath, bool do_compression,
-                                    bool new_file)
+void MCAPSink::restartRecording(const std::string& filepath, const MCAPSinkOptions& options)
+{
+  restartRecordingImpl(filepath, options);
+}
+
+void MCAPSink::restartRecordingImpl(const std::string& filepath,
+                                    const MCAPSinkOptions& options)
 {
   std::scoped_lock lk(mutex_);
-  if(new_file)
   {
-    // if this was called by a user, we need to change the filepath that we will increment when reset
-    file_reset_counter_ = 1;
-    original_filepath_ = filepath;
+    std::scoped_lock rotation_lk(rotation_mutex_);
+    discardNextFile();
   }
+  // a file being closed might have the same name
+  waitRotationTasks();
+
+  // if this was called by a user, we need to change the filepath that we will increment when reset
+  file_reset_counter_ = 1;
+  original_filepath_ = filepath;
   filepath_ = filepath;
-  compression_ = do_compression;
+  options_ = options;
   openFile(filepath_);
 
   // rebuild the channels
@@ -23,6 +23,23 @@ void ROS2PublisherSink::addChannel(const std::string& channel_name, const Schema
 }
 
 bool ROS2PublisherSink::storeSnapshot(const Snapshot& snapshot)
+{
+  publishSchemas();
+  publishSnapshot(snapshot);
+  return true;
+}
+
+bool ROS2PublisherSink::storeSnapshots(SnapshotsSpan snapshots)
+{
+  publishSchemas();
+  for(size_t i = 0; i < snapshots.size(); i++)
+  {
+    publishSnapshot(*snapshots.data()[i]);
+  }
+  return true;
+}
+
+void ROS2PublisherSink::publishSchemas()
 {
   // send the schemas, if you haven't yet.
   if(schema_changed_)
@@ -45,14 +62,15 @@ bool ROS2PublisherSink::storeSnapshot(const Snapshot& snapshot)
     }
     schema_publisher_->publish(msg);
   }
-  //----------------------------------------
+}
+
+void ROS2PublisherSink::publishSnapshot(const Snapshot& snapshot)
+{
   data_msg_.timestamp_nsec = uint64_t(snapshot.timestamp.count());
   data_msg_.schema_hash = snapshot.schema_hash;
   data_msg_.active_mask = snapshot.active_mask;
   data_msg_.payload = snapshot.payload;
   data_publisher_->publish(data_msg_);
-
-  return true;
 }
 
 }  // namespace DataTamer
@@ -0,0 +1,351 @@
+#include "data_tamer/sinks/shm_ring_sink.hpp"
+#include "data_tamer/contrib/SerializeMe.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <sstream>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <mcap/writer.hpp>
+
+/* Layout of the file:
+ *
+ * [ Header (kHeaderSize bytes) ][ schemas area ][ data ring ]
+ *
+ * Schema record: [uint32 record size][uint64 hash][string channel name][string schema]
+ *
+ * Data record:   [uint32 record size][uint64 hash][int64 timestamp]
+ *                [uint32 mask size][mask][uint32 payload size][payload][padding]
+ *
+ * Data records are aligned to 8 bytes. A record size equal to 0 means that the
+ * rest of the ring is unused and the next record is at the beginning.
+ *
+ * Head and tail are monotonic byte counters (the offset in the ring is
+ * counter % capacity). The head is moved before the oldest records are
+ * overwritten and the tail after the new record is completely written; therefore
+ * the records in [head, tail) are always valid, even if the writer dies at any time.
+ */
+
+namespace DataTamer
+{
+
+static constexpr char const* kDataTamer = "data_tamer";
+static constexpr char kRingMagic[8] = { 'D', 'T', 'R', 'I', 'N', 'G', '0', '1' };
+static constexpr size_t kHeaderSize = 4096;
+static constexpr size_t kRecordAlignment = 8;
+// record size, hash, timestamp, mask size, payload size
+static constexpr size_t kRecordOverhead = 4 + 8 + 8 + 4 + 4;
+
+struct ShmRingSink::Header
+{
+  char magic[8];
+  uint64_t schemas_capacity;
+  uint64_t data_capacity;
+  std::atomic_uint64_t schemas_size;
+  std::atomic_uint64_t head;
+  std::atomic_uint64_t tail;
+};
+
+static_assert(std::atomic_uint64_t::is_always_lock_free);
+
+namespace
+{
+size_t AlignRecord(size_t size)
+{
+  return (size + kRecordAlignment - 1) & ~(kRecordAlignment - 1);
+}
+
+uint32_t ReadRecordSize(const uint8_t* data, uint64_t capacity, uint64_t position)
+{
+  uint32_t size = 0;
+  std::memcpy(&size, data + (position % capacity), sizeof(size));
+  return size;
+}
+
+// number of bytes used by the record at position (including the unused end of the ring)
+uint64_t RecordSpan(const uint8_t* data, uint64_t capacity, uint64_t position)
+{
+  const uint32_t size = ReadRecordSize(data, capacity, position);
+  return (size == 0) ? capacity - (position % capacity) : size;
+}
+}  // namespace
+
+ShmRingSink::ShmRingSink(std::string const& filepath, size_t data_capacity,
+                         size_t schemas_capacity)
+{
+  static_assert(sizeof(Header) <= kHeaderSize);
+  data_capacity = AlignRecord(data_capacity);
+  mapped_size_ = kHeaderSize + schemas_capacity + data_capacity;
+
+  const int fd = ::open(filepath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0)
+  {
+    throw std::runtime_error("ShmRingSink: can't open file " + filepath);
+  }
+  if(::ftruncate(fd, off_t(mapped_size_)) != 0)
+  {
+    ::close(fd);
+    throw std::runtime_error("ShmRingSink: can't resize file " + filepath);
+  }
+  void* memory = ::mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  // the mapping is still valid after closing the file
+  ::close(fd);
+  if(memory == MAP_FAILED)
+  {
+    throw std::runtime_error("ShmRingSink: can't map file " + filepath);
+  }
+
+  auto* bytes = static_cast<uint8_t*>(memory);
+  schemas_ = bytes + kHeaderSize;
+  data_ = schemas_ + schemas_capacity;
+
+  header_ = new(memory) Header;
+  header_->schemas_capacity = schemas_capacity;
+  header_->data_capacity = data_capacity;
+  header_->schemas_size = 0;
+  header_->head = 0;
+  header_->tail = 0;
+  // write the magic last: a reader will not use a file partially initialized
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(header_->magic, kRingMagic, sizeof(kRingMagic));
+}
+
+ShmRingSink::~ShmRingSink()
+{
+  stopThread();
+  ::munmap(header_, mapped_size_);
+}
+
+void ShmRingSink::addChannel(std::string const& channel_name, Schema const& schema)
+{
+  std::scoped_lock lk(mutex_);
+  if(known_schemas_.count(schema.hash) != 0)
+  {
+    return;
+  }
+  std::stringstream ss;
+  ss << schema;
+  const std::string schema_str = ss.str();
+
+  const size_t record_size = sizeof(uint32_t) + sizeof(uint64_t) +
+                             SerializeMe::BufferSize(channel_name) +
+                             SerializeMe::BufferSize(schema_str);
+  const auto used = header_->schemas_size.load(std::memory_order_relaxed);
+  if(used + record_size > header_->schemas_capacity)
+  {
+    throw std::runtime_error("ShmRingSink: no space left for the schema of " +
+                             channel_name);
+  }
+  SerializeMe::SpanBytes buffer(schemas_ + used, record_size);
+  SerializeMe::SerializeIntoBuffer(buffer, uint32_t(record_size));
+  SerializeMe::SerializeIntoBuffer(buffer, uint64_t(schema.hash));
+  SerializeMe::SerializeIntoBuffer(buffer, channel_name);
+  SerializeMe::SerializeIntoBuffer(buffer, schema_str);
+  header_->schemas_size.store(used + record_size, std::memory_order_release);
+  known_schemas_.insert(schema.hash);
+}
+
+bool ShmRingSink::pushSnapshot(const SnapshotPtr& snapshot)
+{
+  const bool stored = storeSnapshot(*snapshot);
+  updateStatistics(stored ? 1 : 0, stored ? 0 : 1);
+  return stored;
+}
+
+bool ShmRingSink::pushSnapshots(SnapshotsSpan snapshots)
+{
+  uint64_t stored = 0;
+  for(size_t i = 0; i < snapshots.size(); i++)
+  {
+    stored += storeSnapshot(*snapshots.data()[i]) ? 1 : 0;
+  }
+  updateStatistics(stored, snapshots.size() - stored);
+  return stored == snapshots.size();
+}
+
+bool ShmRingSink::storeSnapshot(const Snapshot& snapshot)
+{
+  const uint64_t capacity = header_->data_capacity;
+  const size_t mask_size = snapshot.active_mask.size();
+  const size_t payload_size = snapshot.payload.size();
+  const size_t record_size = AlignRecord(kRecordOverhead + mask_size + payload_size);
+  if(record_size > capacity)
+  {
+    return false;
+  }
+
+  std::scoped_lock lk(mutex_);
+  uint64_t head = header_->head.load(std::memory_order_relaxed);
+  uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+
+  // the record must be contiguous: if needed, skip the end of the ring
+  const uint64_t offset = tail % capacity;
+  const uint64_t skipped = (offset + record_size > capacity) ? capacity - offset : 0;
+
+  // make space, removing the oldest records
+  while(head < tail && tail + skipped + record_size - head > capacity)
+  {
+    head += RecordSpan(data_, capacity, head);
+  }
+  if(head == tail)
+  {
+    head = tail + skipped;
+  }
+  header_->head.store(head, std::memory_order_release);
+
+  if(skipped > 0)
+  {
+    const uint32_t end_marker = 0;
+    std::memcpy(data_ + offset, &end_marker, sizeof(end_marker));
+    tail += skipped;
+  }
+
+  SerializeMe::SpanBytes buffer(data_ + (tail % capacity), record_size);
+  SerializeMe::SerializeIntoBuffer(buffer, uint32_t(record_size));
+  SerializeMe::SerializeIntoBuffer(buffer, uint64_t(snapshot.schema_hash));
+  SerializeMe::SerializeIntoBuffer(buffer, int64_t(snapshot.timestamp.count()));
+  SerializeMe::SerializeIntoBuffer(buffer, uint32_t(mask_size));
+  std::memcpy(buffer.data(), snapshot.active_mask.data(), mask_size);
+  buffer.trimFront(mask_size);
+  SerializeMe::SerializeIntoBuffer(buffer, uint32_t(payload_size));
+  std::memcpy(buffer.data(), snapshot.payload.data(), payload_size);
+
+  header_->tail.store(tail + record_size, std::memory_order_release);
+  return true;
+}
+
+size_t ShmRingSink::convertToMCAP(std::string const& ring_filepath,
+                                  std::string const& mcap_filepath)
+{
+  const int fd = ::open(ring_filepath.c_str(), O_RDONLY);
+  if(fd < 0)
+  {
+    throw std::runtime_error("ShmRingSink: can't open file " + ring_filepath);
+  }
+  struct stat file_stat = {};
+  ::fstat(fd, &file_stat);
+  const auto file_size = size_t(file_stat.st_size);
+  void* memory = file_size >= kHeaderSize ?
+                     ::mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0) :
+                     MAP_FAILED;
+  ::close(fd);
+  if(memory == MAP_FAILED)
+  {
+    throw std::runtime_error("ShmRingSink: can't map file " + ring_filepath);
+  }
+  // unmap in any case, even if an exception is thrown
+  std::shared_ptr<void> unmap(memory, [file_size](void* ptr) { ::munmap(ptr, file_size); });
+
+  const auto* header = static_cast<const Header*>(memory);
+  const uint64_t schemas_capacity = header->schemas_capacity;
+  const uint64_t capacity = header->data_capacity;
+  // the writer moves the head before the tail
+  const uint64_t head = header->head.load(std::memory_order_acquire);
+  const uint64_t tail = header->tail.load(std::memory_order_acquire);
+  // each field is checked separately: their sum may overflow
+  const uint64_t available = file_size - kHeaderSize;
+  if(std::memcmp(header->magic, kRingMagic, sizeof(kRingMagic)) != 0 ||
+     schemas_capacity > available || capacity == 0 ||
+     capacity > available - schemas_capacity || capacity % kRecordAlignment != 0 ||
+     head > tail || tail - head > capacity || head % kRecordAlignment != 0)
+  {
+    throw std::runtime_error("ShmRingSink: not a valid ring file " + ring_filepath);
+  }
+  const auto* schemas = static_cast<const uint8_t*>(memory) + kHeaderSize;
+  const auto* data = schemas + schemas_capacity;
+  const uint64_t schemas_size =
+      std::min(header->schemas_size.load(std::memory_order_acquire), schemas_capacity);
+
+  mcap::McapWriter writer;
+  if(!writer.open(mcap_filepath, mcap::McapWriterOptions(kDataTamer)).ok())
+  {
+    throw std::runtime_error("Failed to open MCAP file for writing");
+  }
+
+  std::unordered_map<uint64_t, mcap::ChannelId> hash_to_channel_id;
+  SerializeMe::SpanBytesConst schemas_buffer(schemas, schemas_size);
+  while(schemas_buffer.size() > 0)
+  {
+    uint32_t record_size = 0;
+    uint64_t hash = 0;
+    std::string channel_name;
+    std::string schema_str;
+    SerializeMe::DeserializeFromBuffer(schemas_buffer, record_size);
+    SerializeMe::DeserializeFromBuffer(schemas_buffer, hash);
+    SerializeMe::DeserializeFromBuffer(schemas_buffer, channel_name);
+    SerializeMe::DeserializeFromBuffer(schemas_buffer, schema_str);
+
+    mcap::Schema mcap_schema(channel_name + "::" + std::to_string(hash), kDataTamer,
+                             schema_str);
+    writer.addSchema(mcap_schema);
+    mcap::Channel publisher(channel_name, kDataTamer, mcap_schema.id);
+    writer.addChannel(publisher);
+    hash_to_channel_id[hash] = publisher.id;
+  }
+
+  size_t count = 0;
+  // the records of a channel are numbered in the order they are written
+  std::unordered_map<mcap::ChannelId, uint32_t> sequences;
+  uint64_t position = head;
+  while(position < tail)
+  {
+    const uint64_t offset = position % capacity;
+    const uint32_t record_size = ReadRecordSize(data, capacity, position);
+    if(record_size == 0)
+    {
+      position += capacity - offset;
+      continue;
+    }
+    // stop at the first corrupted record
+    if(record_size < kRecordOverhead || offset + record_size > capacity)
+    {
+      break;
+    }
+    SerializeMe::SpanBytesConst buffer(data + offset + sizeof(uint32_t),
+                                       record_size - sizeof(uint32_t));
+    uint64_t hash = 0;
+    int64_t timestamp = 0;
+    SerializeMe::DeserializeFromBuffer(buffer, hash);
+    SerializeMe::DeserializeFromBuffer(buffer, timestamp);
+
+    auto it = hash_to_channel_id.find(hash);
+    if(it != hash_to_channel_id.end())
+    {
+      // the mask and the payload are stored exactly as the MCAPSink does
+      uint32_t mask_size = 0;
+      uint32_t payload_size = 0;
+      std::memcpy(&mask_size, buffer.data(), sizeof(uint32_t));
+      const size_t size_data = sizeof(uint32_t) + mask_size;
+      if(size_data + sizeof(uint32_t) <= buffer.size())
+      {
+        std::memcpy(&payload_size, buffer.data() + size_data, sizeof(uint32_t));
+      }
+      mcap::Message msg;
+      msg.channelId = it->second;
+      msg.sequence = ++sequences[it->second];
+      msg.logTime = mcap::Timestamp(timestamp);
+      msg.publishTime = msg.logTime;
+      msg.data = reinterpret_cast<std::byte const*>(buffer.data());  // NOLINT
+      msg.dataSize = size_data + sizeof(uint32_t) + payload_size;
+      if(msg.dataSize > buffer.size())
+      {
+        break;
+      }
+      if(writer.write(msg).ok())
+      {
+        count++;
+      }
+    }
+    position += record_size;
+  }
+  writer.close();
+  return count;
+}
+
+}  // namespace DataTamer
@@ -3,6 +3,12 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <mutex>
 #include <variant>
 #include <string>
 #include <thread>
@@ -168,6 +174,56 @@ TEST(DataTamerBasic, Vector)
   ASSERT_EQ(sink->latest_snapshot.payload.size(), expected_size);
 }
 
+// a custom buffer that opted-in the bulk serialization of SerializeMe
+struct SampleBuffer
+{
+  std::vector<uint16_t> samples;
+  const uint16_t* data() const { return samples.data(); }
+  size_t size() const { return samples.size(); }
+};
+
+template <>
+struct SerializeMe::is_contiguous_container<SampleBuffer> : std::true_type
+{
+};
+
+TEST(DataTamerBasic, ContiguousContainer)
+{
+  auto channel = LogChannel::create("chan");
+  auto sink = std::make_shared<DummySink>();
+  channel->addDataSink(sink);
+
+  SampleBuffer buffer = { { 1, 2, 3 } };
+  channel->registerValue("buffer", &buffer);
+
+  // serialized like a std::vector of its elements
+  const auto schema = channel->getSchema();
+  const auto& field = schema.fields.front();
+  ASSERT_EQ(field.type, BasicType::UINT16);
+  ASSERT_TRUE(field.is_vector);
+  ASSERT_EQ(field.array_size, 0);
+
+  auto checkPayload = [&]() {
+    channel->takeSnapshot();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    const auto& payload = sink->latest_snapshot.payload;
+    ASSERT_EQ(payload.size(),
+              sizeof(uint32_t) + buffer.samples.size() * sizeof(uint16_t));
+
+    uint32_t size = 0;
+    std::memcpy(&size, payload.data(), sizeof(uint32_t));
+    ASSERT_EQ(size, buffer.samples.size());
+    std::vector<uint16_t> samples(size);
+    std::memcpy(samples.data(), payload.data() + sizeof(uint32_t),
+                size * sizeof(uint16_t));
+    ASSERT_EQ(samples, buffer.samples);
+  };
+
+  checkPayload();
+  buffer.samples = { 7, 8, 9, 10, 11 };
+  checkPayload();
+}
+
 TEST(DataTamerBasic, Disable)
 {
   auto channel = LogChannel::create("chan");
@@ -291,3 +347,754 @@ TEST(DataTamerBasic, LockedPtr)
   // now expect that our assignment to the locked pointer took place
   EXPECT_EQ(logged_float->get(), val2);
 }
+
+TEST(DataTamerBasic, SerializationPlan)
+{
+  auto channel = LogChannel::create("chan");
+  auto sink = std::make_shared<DummySink>();
+  channel->addDataSink(sink);
+
+  // values adjacent in memory, a gap, then a vector
+  std::array<double, 4> values = { 1, 2, 3, 4 };
+  int32_t count = 42;
+  std::vector<int16_t> vect = { 5, 6, 7 };
+
+  std::vector<RegistrationID> ids;
+  for(size_t i = 0; i < values.size(); i++)
+  {
+    ids.push_back(channel->registerValue("v" + std::to_string(i), &values[i]));
+  }
+  channel->registerValue("count", &count);
+  channel->registerValue("vect", &vect);
+
+  auto checkPayload = [&](const std::vector<double>& expected_values) {
+    channel->takeSnapshot();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    const auto& payload = sink->latest_snapshot.payload;
+    const size_t expected_size = expected_values.size() * sizeof(double) +
+                                 sizeof(int32_t) + sizeof(uint32_t) +
+                                 vect.size() * sizeof(int16_t);
+    ASSERT_EQ(payload.size(), expected_size);
+
+    size_t offset = 0;
+    for(const double expected : expected_values)
+    {
+      double value = 0;
+      std::memcpy(&value, payload.data() + offset, sizeof(double));
+      ASSERT_EQ(value, expected);
+      offset += sizeof(double);
+    }
+    int32_t count_out = 0;
+    std::memcpy(&count_out, payload.data() + offset, sizeof(int32_t));
+    ASSERT_EQ(count_out, count);
+    offset += sizeof(int32_t);
+
+    uint32_t vect_size = 0;
+    std::memcpy(&vect_size, payload.data() + offset, sizeof(uint32_t));
+    ASSERT_EQ(vect_size, vect.size());
+    offset += sizeof(uint32_t);
+    for(const int16_t expected : vect)
+    {
+      int16_t value = 0;
+      std::memcpy(&value, payload.data() + offset, sizeof(int16_t));
+      ASSERT_EQ(value, expected);
+      offset += sizeof(int16_t);
+    }
+  };
+
+  checkPayload({ 1, 2, 3, 4 });
+
+  // the plan must follow the changes of the values...
+  values = { 10, 20, 30, 40 };
+  count = 43;
+  vect.push_back(8);
+  checkPayload({ 10, 20, 30, 40 });
+
+  // ...and must be updated when a value is disabled or unregistered
+  channel->setEnabled(ids[1], false);
+  channel->unregister(ids[3]);
+  checkPayload({ 10, 30 });
+}
+
+// sink that keeps track of the address of the snapshots and can be paused
+class PausableSink : public DataSinkBase
+{
+public:
+  std::atomic_bool paused = false;
+  std::atomic_int received = 0;
+  std::atomic<const Snapshot*> latest_address = nullptr;
+  std::atomic_size_t max_batch_size = 0;
+  std::mutex mutex;
+  std::vector<std::chrono::nanoseconds> timestamps;
+
+  ~PausableSink() override
+  {
+    paused = false;
+    stopThread();
+  }
+  void addChannel(std::string const&, Schema const&) override {}
+  bool storeSnapshot(const Snapshot& snapshot) override
+  {
+    latest_address = &snapshot;
+    {
+      std::scoped_lock lk(mutex);
+      timestamps.push_back(snapshot.timestamp);
+    }
+    while(paused)
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    received++;
+    return true;
+  }
+  bool storeSnapshots(SnapshotsSpan snapshots) override
+  {
+    max_batch_size = std::max(max_batch_size.load(), snapshots.size());
+    return DataSinkBase::storeSnapshots(snapshots);
+  }
+};
+
+TEST(DataTamerBasic, SharedSnapshotPool)
+{
+  auto channel = LogChannel::create("chan");
+  auto sink_A = std::make_shared<PausableSink>();
+  auto sink_B = std::make_shared<PausableSink>();
+  channel->addDataSink(sink_A);
+  channel->addDataSink(sink_B);
+
+  double value = 1;
+  channel->registerValue("value", &value);
+
+  // the same instance of Snapshot is shared by both sinks
+  ASSERT_TRUE(channel->takeSnapshot());
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ASSERT_EQ(sink_A->received, 1);
+  ASSERT_EQ(sink_B->received, 1);
+  ASSERT_EQ(sink_A->latest_address.load(), sink_B->latest_address.load());
+
+  // when all the snapshots of the pool are used by the sinks, new snapshots are dropped
+  const int pool_size = 3;
+  channel->setSnapshotPoolSize(pool_size);
+  sink_A->paused = true;
+  for(int i = 0; i < pool_size; i++)
+  {
+    ASSERT_TRUE(channel->takeSnapshot());
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ASSERT_FALSE(channel->takeSnapshot());
+  ASSERT_EQ(channel->droppedSnapshotsCount(), 1);
+
+  // once released, the snapshots are reused
+  sink_A->paused = false;
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ASSERT_TRUE(channel->takeSnapshot());
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ASSERT_EQ(sink_A->received, pool_size + 2);
+  ASSERT_EQ(sink_B->received, pool_size + 2);
+}
+
+TEST(DataTamerBasic, BatchConsumer)
+{
+  auto channel = LogChannel::create("chan");
+  auto sink = std::make_shared<PausableSink>();
+  channel->addDataSink(sink);
+
+  double value = 1;
+  channel->registerValue("value", &value);
+
+  // a single snapshot is processed immediately
+  ASSERT_TRUE(channel->takeSnapshot());
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ASSERT_EQ(sink->received, 1);
+  ASSERT_EQ(sink->max_batch_size, 1);
+
+  // the snapshots pushed while the sink is busy are consumed in batches
+  sink->paused = true;
+  ASSERT_TRUE(channel->takeSnapshot());
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  const int count = 20;
+  for(int i = 0; i < count; i++)
+  {
+    ASSERT_TRUE(channel->takeSnapshot());
+  }
+  sink->paused = false;
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ASSERT_EQ(sink->received, count + 2);
+  ASSERT_EQ(sink->max_batch_size, count);
+}
+
+TEST(DataTamerBasic, QueueOverflowPolicies)
+{
+  using std::chrono::nanoseconds;
+  const size_t capacity = 2;
+
+  auto fillQueue = [&](OverflowPolicy policy) {
+    auto channel = LogChannel::create("chan");
+    auto sink = std::make_shared<PausableSink>();
+    sink->setQueueCapacity(capacity);
+    sink->setOverflowPolicy(policy, std::chrono::milliseconds(20));
+    channel->addDataSink(sink);
+    double value = 1;
+    channel->registerValue("value", &value);
+
+    // the first snapshot is popped from the queue and blocks the consumer thread
+    sink->paused = true;
+    EXPECT_TRUE(channel->takeSnapshot(nanoseconds(1)));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    std::vector<bool> pushed;
+    for(int i = 2; i <= 5; i++)
+    {
+      pushed.push_back(channel->takeSnapshot(nanoseconds(i)));
+    }
+    sink->paused = false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return std::make_pair(pushed, sink);
+  };
+
+  {
+    auto [pushed, sink] = fillQueue(OverflowPolicy::DROP_NEWEST);
+    ASSERT_EQ(pushed, std::vector<bool>({ true, true, false, false }));
+    ASSERT_EQ(sink->timestamps, std::vector<nanoseconds>({ nanoseconds(1), nanoseconds(2),
+                                                           nanoseconds(3) }));
+    const auto stats = sink->getStatistics();
+    ASSERT_EQ(stats.enqueued, 3);
+    ASSERT_EQ(stats.dropped, 2);
+    ASSERT_EQ(stats.stored, 3);
+  }
+  {
+    auto [pushed, sink] = fillQueue(OverflowPolicy::DROP_OLDEST);
+    ASSERT_EQ(pushed, std::vector<bool>({ true, true, true, true }));
+    ASSERT_EQ(sink->timestamps, std::vector<nanoseconds>({ nanoseconds(1), nanoseconds(4),
+                                                           nanoseconds(5) }));
+    const auto stats = sink->getStatistics();
+    ASSERT_EQ(stats.enqueued, 5);
+    ASSERT_EQ(stats.dropped, 2);
+    ASSERT_EQ(stats.stored, 3);
+  }
+  {
+    // the timeout expires, because the consumer is paused
+    auto [pushed, sink] = fillQueue(OverflowPolicy::BLOCK);
+    ASSERT_EQ(pushed, std::vector<bool>({ true, true, false, false }));
+    const auto stats = sink->getStatistics();
+    ASSERT_EQ(stats.dropped, 2);
+  }
+  {
+    // the producer is unblocked when the consumer makes space in the queue
+    auto channel = LogChannel::create("chan");
+    auto sink = std::make_shared<PausableSink>();
+    sink->setQueueCapacity(1);
+    sink->setOverflowPolicy(OverflowPolicy::BLOCK, std::chrono::seconds(5));
+    channel->addDataSink(sink);
+    double value = 1;
+    channel->registerValue("value", &value);
+
+    sink->paused = true;
+    ASSERT_TRUE(channel->takeSnapshot());
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ASSERT_TRUE(channel->takeSnapshot());
+
+    std::thread unpause([&]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      sink->paused = false;
+    });
+    ASSERT_TRUE(channel->takeSnapshot());
+    unpause.join();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ASSERT_EQ(sink->getStatistics().stored, 3);
+    ASSERT_EQ(sink->getStatistics().dropped, 0);
+  }
+}
+
+TEST(DataTamerBasic, QueueOverflowDefaultSizes)
+{
+  // with the default sizes, the pool must not run out of snapshots before the
+  // queue of the sink is full: the OverflowPolicy decides what is dropped.
+  const size_t extra = 100;
+
+  auto fillQueue = [&](OverflowPolicy policy) {
+    auto channel = LogChannel::create("chan");
+    auto sink = std::make_shared<PausableSink>();
+    sink->setOverflowPolicy(policy, std::chrono::microseconds(100));
+    channel->addDataSink(sink);
+    double value = 1;
+    channel->registerValue("value", &value);
+
+    // the first snapshot is popped from the queue and blocks the consumer thread
+    sink->paused = true;
+    EXPECT_TRUE(channel->takeSnapshot());
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    size_t pushed = 0;
+    for(size_t i = 0; i < DataSinkBase::kDefaultQueueCapacity + extra; i++)
+    {
+      pushed += channel->takeSnapshot() ? 1 : 0;
+    }
+    EXPECT_EQ(channel->droppedSnapshotsCount(), 0);
+    sink->paused = false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    return std::make_pair(pushed, sink->getStatistics());
+  };
+
+  {
+    auto [pushed, stats] = fillQueue(OverflowPolicy::DROP_NEWEST);
+    ASSERT_EQ(pushed, DataSinkBase::kDefaultQueueCapacity);
+    ASSERT_EQ(stats.dropped, extra);
+    ASSERT_EQ(stats.stored, DataSinkBase::kDefaultQueueCapacity + 1);
+  }
+  {
+    auto [pushed, stats] = fillQueue(OverflowPolicy::DROP_OLDEST);
+    ASSERT_EQ(pushed, DataSinkBase::kDefaultQueueCapacity + extra);
+    ASSERT_EQ(stats.dropped, extra);
+    ASSERT_EQ(stats.stored, DataSinkBase::kDefaultQueueCapacity + 1);
+  }
+  {
+    auto [pushed, stats] = fillQueue(OverflowPolicy::BLOCK);
+    ASSERT_EQ(pushed, DataSinkBase::kDefaultQueueCapacity);
+    ASSERT_EQ(stats.dropped, extra);
+    ASSERT_EQ(stats.stored, DataSinkBase::kDefaultQueueCapacity + 1);
+  }
+}
+
+TEST(DataTamerBasic, Deadband)
+{
+  using std::chrono::milliseconds;
+  auto channel = LogChannel::create("chan");
+  auto sink = std::make_shared<DummySink>();
+  channel->addDataSink(sink);
+
+  double v1 = 0;
+  int32_t v2 = 42;
+  auto id_v1 = channel->registerValue("v1", &v1);
+  channel->registerValue("v2", &v2);
+  auto v3 = channel->createLoggedValue<float>("v3", 1.0f);
+
+  // an empty vector, serialized as its size only
+  std::vector<double> vect;
+  ASSERT_ANY_THROW(channel->setDeadband(channel->registerValue("vect", &vect), Deadband{}));
+
+  channel->setDeadband(id_v1, Deadband{ 0.5, milliseconds(100) });
+  // record only when it changes
+  v3->setDeadband(Deadband{ 0.0, std::chrono::seconds(10) });
+
+  auto checkSnapshot = [&](int time_ms, double value, uint8_t expected_mask) {
+    v1 = value;
+    channel->takeSnapshot(milliseconds(time_ms));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ASSERT_EQ(sink->latest_snapshot.active_mask[0] & 0b1111, expected_mask);
+    size_t expected_size = sizeof(int32_t) + sizeof(uint32_t);
+    expected_size += (expected_mask & 0b0001) ? sizeof(double) : 0;
+    expected_size += (expected_mask & 0b0100) ? sizeof(float) : 0;
+    ASSERT_EQ(sink->latest_snapshot.payload.size(), expected_size);
+  };
+
+  checkSnapshot(0, 1.0, 0b1111);
+  checkSnapshot(10, 1.3, 0b1010);
+  checkSnapshot(20, 1.6, 0b1011);
+  v3->set(2.0f);
+  checkSnapshot(30, 1.6, 0b1110);
+  // max_hold expired
+  checkSnapshot(130, 1.6, 0b1011);
+
+  channel->setDeadband(id_v1, std::nullopt);
+  checkSnapshot(140, 1.6, 0b1011);
+}
+
+TEST(DataTamerBasic, Decimation)
+{
+  ActiveMask mask(10, 0xFF);
+  ActiveMask bits(10, 0);
+  SetBit(bits, 3, true);
+  SetBit(bits, 70, true);
+  ClearBits(mask, bits);
+  for(size_t i = 0; i < 80; i++)
+  {
+    ASSERT_EQ(GetBit(mask, i), i != 3 && i != 70);
+  }
+
+  auto channel = LogChannel::create("chan");
+  auto sink = std::make_shared<DummySink>();
+  channel->addDataSink(sink);
+
+  double v1 = 1;
+  int32_t v2 = 2;
+  channel->registerValue("v1", &v1);
+  auto id_v2 = channel->registerValue("v2", &v2);
+  auto v3 = channel->createLoggedValue<uint16_t>("v3", 3);
+
+  channel->setDecimation(id_v2, 2);
+  v3->setDecimation(3);
+
+  for(int i = 0; i < 7; i++)
+  {
+    channel->takeSnapshot();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    const bool has_v2 = (i % 2 == 0);
+    const bool has_v3 = (i % 3 == 0);
+    const auto& snapshot = sink->latest_snapshot;
+    ASSERT_TRUE(GetBit(snapshot.active_mask, 0));
+    ASSERT_EQ(GetBit(snapshot.active_mask, 1), has_v2);
+    ASSERT_EQ(GetBit(snapshot.active_mask, 2), has_v3);
+    const size_t expected_size = sizeof(double) + (has_v2 ? sizeof(int32_t) : 0) +
+                                 (has_v3 ? sizeof(uint16_t) : 0);
+    ASSERT_EQ(snapshot.payload.size(), expected_size);
+  }
+}
+
+// sink that checks that the two values of the snapshot are always equal
+class ConsistencySink : public DataSinkBase
+{
+public:
+  std::atomic_int received = 0;
+  std::atomic_int torn = 0;
+
+  ~ConsistencySink() override { stopThread(); }
+  void addChannel(std::string const&, Schema const&) override {}
+  bool storeSnapshot(const Snapshot& snapshot) override
+  {
+    int64_t values[2];
+    if(snapshot.payload.size() < sizeof(values))
+    {
+      return true;
+    }
+    std::memcpy(values, snapshot.payload.data(), sizeof(values));
+    torn += (values[0] != values[1]) ? 1 : 0;
+    received++;
+    return true;
+  }
+};
+
+TEST(DataTamerBasic, SeqLock)
+{
+  auto channel = LogChannel::create("chan");
+  auto sink = std::make_shared<ConsistencySink>();
+  channel->addDataSink(sink);
+  channel->setSeqLockMode(true);
+  ASSERT_NE(channel->seqLock(), nullptr);
+
+  int64_t a = 0;
+  int64_t b = 0;
+  channel->registerValue("a", &a);
+  channel->registerValue("b", &b);
+  auto counter = channel->createLoggedValue<int64_t>("counter");
+
+  std::atomic_bool stop = false;
+  std::thread writer_pair([&]() {
+    for(int64_t i = 1; !stop; i++)
+    {
+      const SeqLockWriteGuard guard(*channel->seqLock());
+      a = i;
+      b = i;
+    }
+  });
+  std::thread writer_logged([&]() {
+    while(!stop)
+    {
+      if(auto ptr = counter->getMutablePtr())
+      {
+        (*ptr)++;
+      }
+      counter->set(counter->get() + 1);
+    }
+  });
+
+  int taken = 0;
+  for(int i = 0; i < 500; i++)
+  {
+    taken += channel->takeSnapshot() ? 1 : 0;
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  stop = true;
+  writer_pair.join();
+  writer_logged.join();
+
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while(sink->received < taken && std::chrono::steady_clock::now() < deadline)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_GT(taken, 0);
+  ASSERT_EQ(taken + int(channel->tornSnapshotsCount()), 500);
+  ASSERT_EQ(sink->received, taken);
+  ASSERT_EQ(sink->torn, 0);
+
+  channel->setSeqLockMode(false);
+  ASSERT_EQ(channel->seqLock(), nullptr);
+}
+
+TEST(DataTamerBasic, AtomicLoggedValue)
+{
+  static_assert(AtomicLoggedValue<double>::kUseAtomic);
+  static_assert(!AtomicLoggedValue<std::array<int64_t, 2>>::kUseAtomic);
+
+  auto channel = LogChannel::create("chan");
+  auto sink = std::make_shared<ConsistencySink>();
+  channel->addDataSink(sink);
+
+  // stored in a TripleBuffer
+  auto pair = channel->createAtomicLoggedValue<std::array<int64_t, 2>>("pair");
+  // stored in a std::atomic
+  auto scalar = channel->createAtomicLoggedValue<double>("scalar", 1.0);
+  ASSERT_EQ(scalar->get(), 1.0);
+  scalar->set(2.0);
+  ASSERT_EQ(scalar->get(), 2.0);
+
+  std::atomic_bool stop = false;
+  std::thread writer([&]() {
+    for(int64_t i = 1; !stop; i++)
+    {
+      pair->set({ i, i });
+      scalar->set(double(i));
+    }
+  });
+
+  for(int i = 0; i < 200; i++)
+  {
+    ASSERT_TRUE(channel->takeSnapshot());
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  stop = true;
+  writer.join();
+
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while(sink->received < 200 && std::chrono::steady_clock::now() < deadline)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_EQ(sink->received, 200);
+  ASSERT_EQ(sink->torn, 0);
+
+  // destroyed values are not updated anymore by takeSnapshot
+  pair.reset();
+  scalar->setEnabled(false);
+  ASSERT_FALSE(scalar->isEnabled());
+  scalar->set(3.0);
+  ASSERT_TRUE(scalar->isEnabled());
+  ASSERT_TRUE(channel->takeSnapshot());
+}
+
+TEST(DataTamerBasic, ConcurrentSnapshots)
+{
+  auto channel = LogChannel::create("chan");
+  auto sink = std::make_shared<ConsistencySink>();
+  channel->addDataSink(sink);
+
+  const int64_t a = 42;
+  const int64_t b = 42;
+  std::vector<double> vect(100, 1.0);
+  channel->registerValue("a", &a);
+  channel->registerValue("b", &b);
+  channel->registerValue("vect", &vect);
+
+  const int kThreads = 4;
+  const int kSnapshots = 200;
+  std::atomic_int taken = 0;
+  std::vector<std::thread> threads;
+  for(int t = 0; t < kThreads; t++)
+  {
+    threads.emplace_back([&, t]() {
+      for(int i = 0; i < kSnapshots; i++)
+      {
+        const auto timestamp = std::chrono::nanoseconds(t * kSnapshots + i);
+        taken += channel->takeSnapshot(timestamp) ? 1 : 0;
+      }
+    });
+  }
+  for(auto& thread : threads)
+  {
+    thread.join();
+  }
+  ASSERT_EQ(taken, kThreads * kSnapshots);
+
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while(sink->received < taken && std::chrono::steady_clock::now() < deadline)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_EQ(sink->received, taken);
+  ASSERT_EQ(sink->torn, 0);
+}
+
+// sink that records the timestamps of each channel
+class TimestampsSink : public DataSinkBase
+{
+public:
+  std::mutex mutex;
+  std::map<std::string, std::vector<std::chrono::nanoseconds>> timestamps;
+
+  ~TimestampsSink() override { stopThread(); }
+  void addChannel(std::string const&, Schema const&) override {}
+  bool storeSnapshot(const Snapshot& snapshot) override
+  {
+    std::scoped_lock lk(mutex);
+    timestamps[std::string(snapshot.channel_name)].push_back(snapshot.timestamp);
+    return true;
+  }
+};
+
+TEST(DataTamerBasic, Scheduler)
+{
+  using namespace std::chrono_literals;
+  ChannelsRegistry registry;
+  auto sink = std::make_shared<TimestampsSink>();
+  registry.addDefaultSink(sink);
+
+  double value = 0;
+  for(const auto* name : { "fast_A", "fast_B", "slow" })
+  {
+    registry.getChannel(name)->registerValue("value", &value);
+  }
+  EXPECT_THROW(registry.schedule("fast_A", 0ms), std::runtime_error);
+
+  registry.schedule("fast_A", 10ms);
+  registry.schedule("fast_B", 10ms);
+  registry.schedule("slow", 40ms);
+  std::this_thread::sleep_for(200ms);
+  registry.unschedule("fast_B");
+  ASSERT_FALSE(registry.getScheduleStatistics("fast_B"));
+
+  auto stats = registry.getScheduleStatistics("fast_A");
+  ASSERT_TRUE(stats);
+  ASSERT_GE(stats->snapshots, 5u);
+  ASSERT_GE(stats->max_jitter, stats->mean_jitter);
+  registry.clear();
+  ASSERT_FALSE(registry.getScheduleStatistics("fast_A"));
+
+  std::this_thread::sleep_for(20ms);
+  std::scoped_lock lk(sink->mutex);
+  auto& fast_A = sink->timestamps["fast_A"];
+  auto& fast_B = sink->timestamps["fast_B"];
+  auto& slow = sink->timestamps["slow"];
+  ASSERT_GE(fast_A.size(), 5u);
+  ASSERT_GE(slow.size(), 1u);
+  ASSERT_LT(slow.size(), fast_A.size());
+  // channels with the same period share the timestamp
+  ASSERT_GE(fast_B.size(), 1u);
+  for(auto const& timestamp : fast_B)
+  {
+    ASSERT_NE(std::find(fast_A.begin(), fast_A.end(), timestamp), fast_A.end());
+  }
+}
+
+// sink that takes a long time to accept a snapshot
+class SlowPushSink : public DummySink
+{
+public:
+  std::atomic_bool in_push = false;
+
+  // used by the scheduler
+  bool pushSnapshots(SnapshotsSpan snapshots) override
+  {
+    in_push = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    in_push = false;
+    return DummySink::pushSnapshots(snapshots);
+  }
+};
+
+TEST(DataTamerBasic, SchedulerSlowSnapshot)
+{
+  using namespace std::chrono_literals;
+  ChannelsRegistry registry;
+  auto sink = std::make_shared<SlowPushSink>();
+  registry.addDefaultSink(sink);
+
+  double value = 0;
+  registry.getChannel("slow_snapshot")->registerValue("value", &value);
+  registry.schedule("slow_snapshot", 10ms);
+  while(!sink->in_push)
+  {
+    std::this_thread::sleep_for(1ms);
+  }
+  // the scheduler doesn't hold its lock while taking the snapshots
+  const auto start = std::chrono::steady_clock::now();
+  ASSERT_TRUE(registry.getScheduleStatistics("slow_snapshot"));
+  registry.schedule("other", 10ms);
+  ASSERT_LT(std::chrono::steady_clock::now() - start, 50ms);
+  ASSERT_TRUE(sink->in_push);
+  registry.clear();
+}
+
+TEST(DataTamerBasic, GroupSnapshot)
+{
+  ChannelsRegistry registry;
+  auto sink = std::make_shared<PausableSink>();
+  registry.addDefaultSink(sink);
+
+  double value = 0;
+  std::vector<std::shared_ptr<LogChannel>> group;
+  for(const auto* name : { "planner", "controller", "estimator" })
+  {
+    group.push_back(registry.getChannel(name));
+    group.back()->registerValue("value", &value);
+  }
+
+  ASSERT_TRUE(registry.takeSnapshot(group, std::chrono::nanoseconds(42)));
+
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while(sink->received < 3 && std::chrono::steady_clock::now() < deadline)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_EQ(sink->received, 3);
+  // pushed together, stored together
+  ASSERT_EQ(sink->max_batch_size, 3u);
+  std::scoped_lock lk(sink->mutex);
+  for(auto const& timestamp : sink->timestamps)
+  {
+    ASSERT_EQ(timestamp.count(), 42);
+  }
+  ASSERT_EQ(sink->getStatistics().enqueued, 3u);
+}
+
+class FixedClock : public ClockBase
+{
+public:
+  std::chrono::nanoseconds now() override { return std::chrono::nanoseconds(1234); }
+};
+
+TEST(DataTamerBasic, Clocks)
+{
+  using namespace std::chrono;
+  TSCClock tsc_clock(milliseconds(20));
+  SystemClock system_clock;
+  if(TSCClock::IsAvailable())
+  {
+    ASSERT_GT(tsc_clock.ticksPerNanosecond(), 0.0);
+  }
+  nanoseconds prev_steady = SteadyClock().now();
+  for(int i = 0; i < 10; i++)
+  {
+    // the TSC is synchronized again during this loop
+    const auto tsc_time = tsc_clock.now();
+    const auto system_time = system_clock.now();
+    ASSERT_LT(abs(tsc_time - system_time), milliseconds(1));
+
+    const auto steady = SteadyClock().now();
+    ASSERT_GE(steady, prev_steady);
+    prev_steady = steady;
+    std::this_thread::sleep_for(milliseconds(5));
+  }
+
+  ChannelsRegistry registry;
+  auto sink = std::make_shared<PausableSink>();
+  registry.addDefaultSink(sink);
+  registry.setClock(std::make_shared<FixedClock>());
+  auto channel = registry.getChannel("chan");
+  double value = 0;
+  channel->registerValue("value", &value);
+
+  ASSERT_TRUE(channel->takeSnapshot());
+  ASSERT_TRUE(registry.takeSnapshot({ channel }));
+  const auto deadline = steady_clock::now() + seconds(5);
+  while(sink->received < 2 && steady_clock::now() < deadline)
+  {
+    std::this_thread::sleep_for(milliseconds(1));
+  }
+  std::scoped_lock lk(sink->mutex);
+  ASSERT_EQ(sink->timestamps.size(), 2u);
+  for(auto const& timestamp : sink->timestamps)
+  {
+    ASSERT_EQ(timestamp.count(), 1234);
+  }
+}
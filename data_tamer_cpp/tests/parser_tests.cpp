@@ -4,6 +4,7 @@
 #include "../examples/geometry_types.hpp"
 
 #include <gtest/gtest.h>
+#include <mutex>
 #include <thread>
 #include <variant>
 #include <string>
@@ -291,3 +292,416 @@ TEST(DataTamerParser, VectorParsing)
   ASSERT_EQ(parsed_values.at("quats[1]/y"), 32);
   ASSERT_EQ(parsed_values.at("quats[1]/z"), 33);
 }
+
+// keep all the snapshots received
+class CollectSink : public DataTamer::DataSinkBase
+{
+public:
+  std::vector<DataTamer::Snapshot> snapshots;
+  std::mutex mutex;
+
+  ~CollectSink() override { stopThread(); }
+
+  void addChannel(std::string const&, DataTamer::Schema const&) override {}
+
+  bool storeSnapshot(const DataTamer::Snapshot& snapshot) override
+  {
+    std::scoped_lock lk(mutex);
+    snapshots.push_back(snapshot);
+    return true;
+  }
+};
+
+TEST(DataTamerParser, DeltaSnapshots)
+{
+  auto channel = DataTamer::LogChannel::create("channel");
+  auto sink = std::make_shared<CollectSink>();
+  channel->addDataSink(sink);
+  channel->setDeltaMode(true, 10);
+
+  int32_t counter = 0;
+  double config = 42;
+  std::array<float, 3> array = { 1, 2, 3 };
+  std::vector<double> vect = { 4, 5 };
+  Pose pose;
+  pose.pos = { 1, 2, 3 };
+  uint8_t disabled = 9;
+
+  channel->registerValue("counter", &counter);
+  channel->registerValue("config", &config);
+  channel->registerValue("array", &array);
+  channel->registerValue("vect", &vect);
+  channel->registerValue("pose", &pose);
+  auto id = channel->registerValue("disabled", &disabled);
+  channel->setEnabled(id, false);
+
+  const int kCount = 25;
+  for(int i = 0; i < kCount; i++)
+  {
+    counter = i;
+    if(i == 5)
+    {
+      array[1] = 20;
+    }
+    channel->takeSnapshot(std::chrono::nanoseconds(i));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  const auto schema = BuilSchemaFromText(ToStr(channel->getSchema()));
+  DeltaDecoder decoder(schema);
+
+  std::scoped_lock lk(sink->mutex);
+  ASSERT_EQ(sink->snapshots.size(), kCount);
+  for(int i = 0; i < kCount; i++)
+  {
+    const auto snapshot_view = ConvertSnapshot(sink->snapshots[size_t(i)]);
+    // a keyframe every 10 snapshots
+    ASSERT_EQ(DeltaDecoder::IsDelta(schema, snapshot_view), i % 10 != 0);
+    if(i % 10 != 0 && i != 5)
+    {
+      // only counter, vect and pose
+      const size_t expected_size =
+          sizeof(int32_t) + sizeof(uint32_t) + 2 * sizeof(double) + sizeof(Pose);
+      ASSERT_EQ(snapshot_view.payload.size, expected_size);
+    }
+
+    SnapshotView decoded;
+    ASSERT_TRUE(decoder.decode(snapshot_view, decoded));
+
+    std::map<std::string, double> parsed_values;
+    auto callback = [&](const std::string& field_name, const VarNumber& number) {
+      parsed_values[field_name] =
+          std::visit([](const auto& var) { return double(var); }, number);
+    };
+    ParseSnapshot(schema, decoded, callback);
+
+    ASSERT_EQ(parsed_values.size(), 1 + 1 + 3 + 2 + 7);
+    ASSERT_EQ(parsed_values.at("counter"), i);
+    ASSERT_EQ(parsed_values.at("config"), 42);
+    ASSERT_EQ(parsed_values.at("array[1]"), i < 5 ? 2 : 20);
+    ASSERT_EQ(parsed_values.at("array[2]"), 3);
+    ASSERT_EQ(parsed_values.at("vect[1]"), 5);
+    ASSERT_EQ(parsed_values.at("pose/position/z"), 3);
+  }
+
+  // the snapshot where array[1] changed is lost: the values that are not in the
+  // following payloads are missing, until the next keyframe
+  DeltaDecoder lossy_decoder(schema);
+  for(int i = 0; i < 15; i++)
+  {
+    const auto snapshot_view = ConvertSnapshot(sink->snapshots[size_t(i)]);
+    ASSERT_EQ(DeltaDecoder::Sequence(schema, snapshot_view), uint32_t(i));
+    if(i == 5)
+    {
+      continue;
+    }
+    SnapshotView decoded;
+    ASSERT_TRUE(lossy_decoder.decode(snapshot_view, decoded));
+
+    std::map<std::string, double> parsed_values;
+    auto callback = [&](const std::string& field_name, const VarNumber& number) {
+      parsed_values[field_name] =
+          std::visit([](const auto& var) { return double(var); }, number);
+    };
+    ParseSnapshot(schema, decoded, callback);
+    const bool after_gap = (i > 5 && i < 10);
+    ASSERT_EQ(parsed_values.at("counter"), i);
+    ASSERT_EQ(parsed_values.count("config"), after_gap ? 0 : 1);
+    ASSERT_EQ(parsed_values.count("array[1]"), after_gap ? 0 : 1);
+    if(!after_gap)
+    {
+      ASSERT_EQ(parsed_values.at("array[1]"), i < 5 ? 2 : 20);
+    }
+  }
+}
+
+TEST(DataTamerParser, DeltaSnapshotsDeadband)
+{
+  auto channel = DataTamer::LogChannel::create("channel");
+  auto sink = std::make_shared<CollectSink>();
+  channel->addDataSink(sink);
+  channel->setDeltaMode(true, 4);
+
+  int32_t counter = 0;
+  double noisy = 0;
+  channel->registerValue("counter", &counter);
+  auto id = channel->registerValue("noisy", &noisy);
+  channel->setDeadband(id, DataTamer::Deadband{ 0.5, std::chrono::seconds(10) });
+
+  const int kCount = 9;
+  for(int i = 0; i < kCount; i++)
+  {
+    counter = i;
+    noisy = (i < 6) ? 0.1 * i : 5.0;
+    channel->takeSnapshot(std::chrono::nanoseconds(i));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  const auto schema = BuilSchemaFromText(ToStr(channel->getSchema()));
+  DeltaDecoder decoder(schema);
+
+  std::scoped_lock lk(sink->mutex);
+  ASSERT_EQ(sink->snapshots.size(), kCount);
+  for(int i = 0; i < kCount; i++)
+  {
+    const auto snapshot_view = ConvertSnapshot(sink->snapshots[size_t(i)]);
+    SnapshotView decoded;
+    ASSERT_TRUE(decoder.decode(snapshot_view, decoded));
+
+    std::map<std::string, double> parsed_values;
+    auto callback = [&](const std::string& field_name, const VarNumber& number) {
+      parsed_values[field_name] =
+          std::visit([](const auto& var) { return double(var); }, number);
+    };
+    ParseSnapshot(schema, decoded, callback);
+
+    ASSERT_EQ(parsed_values.at("counter"), i);
+    // a value inside the deadband is missing, both in keyframes and delta snapshots
+    const bool recorded = (i == 0 || i == 6);
+    ASSERT_EQ(parsed_values.count("noisy"), recorded ? 1 : 0) << "snapshot " << i;
+    if(recorded)
+    {
+      ASSERT_EQ(parsed_values.at("noisy"), i == 0 ? 0.0 : 5.0);
+    }
+  }
+}
+
+TEST(DataTamerParser, ParsePlan)
+{
+  auto channel = DataTamer::LogChannel::create("channel");
+  auto sink = std::make_shared<CollectSink>();
+  channel->addDataSink(sink);
+
+  int32_t counter = 0;
+  std::array<Point3D, 2> points;
+  points[1] = { 4, 5, 6 };
+  std::vector<Quaternion> quats(1);
+  std::vector<double> vect = { 1 };
+  Pose pose;
+  pose.pos = { 1, 2, 3 };
+  uint8_t flag = 7;
+
+  channel->registerValue("counter", &counter);
+  channel->registerValue("points", &points);
+  channel->registerValue("quats", &quats);
+  channel->registerValue("vect", &vect);
+  channel->registerValue("pose", &pose);
+  auto flag_id = channel->registerValue("flag", &flag);
+
+  const int kCount = 5;
+  for(int i = 0; i < kCount; i++)
+  {
+    counter = i;
+    // the size of the dynamic vectors changes
+    quats.resize(size_t(i % 3 + 1), { double(i), 1, 2, 3 });
+    vect.resize(size_t(i + 1), 42);
+    channel->setEnabled(flag_id, i % 2 == 0);
+    channel->takeSnapshot(std::chrono::nanoseconds(i));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  const auto schema = BuilSchemaFromText(ToStr(channel->getSchema()));
+  ParsePlan plan(schema);
+
+  std::scoped_lock lk(sink->mutex);
+  ASSERT_EQ(sink->snapshots.size(), kCount);
+  for(const auto& snapshot : sink->snapshots)
+  {
+    const auto snapshot_view = ConvertSnapshot(snapshot);
+
+    std::vector<std::pair<std::string, double>> expected;
+    ParseSnapshot(schema, snapshot_view,
+                  [&](const std::string& field_name, const VarNumber& number) {
+                    expected.emplace_back(
+                        field_name,
+                        std::visit([](const auto& var) { return double(var); }, number));
+                  });
+
+    std::vector<std::pair<std::string, double>> parsed;
+    ASSERT_TRUE(plan.parse(snapshot_view, [&](uint32_t series_id, auto value) {
+      parsed.emplace_back(plan.seriesName(series_id), double(value));
+    }));
+    ASSERT_EQ(parsed, expected);
+  }
+  // 1 + 2*3 + 3*4 + 5 + 7 + 1
+  ASSERT_EQ(plan.seriesCount(), 32);
+  ASSERT_EQ(plan.seriesName(0), "counter");
+  ASSERT_EQ(plan.seriesType(0), BasicType::INT32);
+
+  auto other = ConvertSnapshot(sink->snapshots.front());
+  other.schema_hash++;
+  ASSERT_FALSE(plan.parse(other, [](uint32_t, auto) {}));
+}
+
+TEST(DataTamerParser, ColumnarDecoder)
+{
+  auto channel = DataTamer::LogChannel::create("channel");
+  auto sink = std::make_shared<CollectSink>();
+  channel->addDataSink(sink);
+
+  int32_t counter = 0;
+  bool is_even = false;
+  std::vector<float> vect;
+  Pose pose;
+  pose.pos = { 1, 2, 3 };
+  uint8_t flag = 7;
+
+  channel->registerValue("counter", &counter);
+  channel->registerValue("is_even", &is_even);
+  channel->registerValue("vect", &vect);
+  channel->registerValue("pose", &pose);
+  auto flag_id = channel->registerValue("flag", &flag);
+
+  const int kCount = 20;
+  for(int i = 0; i < kCount; i++)
+  {
+    counter = i;
+    is_even = (i % 2 == 0);
+    vect.resize(size_t(i % 4), float(i));
+    pose.rot.w = i;
+    channel->setEnabled(flag_id, i % 3 != 0);
+    channel->takeSnapshot(std::chrono::nanoseconds(i));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  const auto schema = BuilSchemaFromText(ToStr(channel->getSchema()));
+  std::scoped_lock lk(sink->mutex);
+  ASSERT_EQ(sink->snapshots.size(), kCount);
+  std::vector<SnapshotView> views;
+  for(const auto& snapshot : sink->snapshots)
+  {
+    views.push_back(ConvertSnapshot(snapshot));
+  }
+
+  // one at a time, then in a batch
+  ColumnarDecoder decoder(schema);
+  ASSERT_TRUE(decoder.append(views.front()));
+  ASSERT_TRUE(decoder.append(views.data() + 1, views.size() - 1));
+  ASSERT_EQ(decoder.rows(), kCount);
+
+  const auto& columns = decoder.columns();
+  // counter, is_even, vect[0..2], pose (7), flag
+  ASSERT_EQ(columns.size(), 13);
+  auto column = [&](const std::string& name) -> const ColumnarDecoder::Column& {
+    for(const auto& col : columns)
+    {
+      if(col.name == name)
+      {
+        return col;
+      }
+    }
+    throw std::runtime_error("missing column " + name);
+  };
+  const auto& counters = column("counter").get<int32_t>();
+  const auto& evens = column("is_even").get<uint8_t>();
+  const auto& rot_w = column("pose/rotation/w").get<double>();
+  const auto& flags = column("flag").get<uint8_t>();
+  const auto& vect_2 = column("vect[2]").get<float>();
+
+  for(int i = 0; i < kCount; i++)
+  {
+    const auto row = size_t(i);
+    ASSERT_EQ(decoder.timestamps()[row], uint64_t(i));
+    ASSERT_EQ(counters[row], i);
+    ASSERT_EQ(evens[row], i % 2 == 0);
+    ASSERT_EQ(rot_w[row], i);
+    ASSERT_TRUE(column("pose/rotation/w").isValid(row));
+
+    ASSERT_EQ(column("flag").isValid(row), i % 3 != 0);
+    ASSERT_EQ(flags[row], i % 3 != 0 ? 7 : 0);
+
+    ASSERT_EQ(column("vect[2]").isValid(row), i % 4 == 3);
+    ASSERT_EQ(vect_2[row], i % 4 == 3 ? float(i) : 0.0f);
+  }
+
+  decoder.clear();
+  ASSERT_EQ(decoder.rows(), 0);
+  ASSERT_TRUE(decoder.append(views.data(), 4));
+  ASSERT_EQ(column("counter").get<int32_t>().size(), 4);
+
+  auto other = views.front();
+  other.schema_hash++;
+  ASSERT_FALSE(decoder.append(other));
+  ASSERT_EQ(decoder.rows(), 4);
+}
+
+TEST(DataTamerParser, ParseProjection)
+{
+  auto channel = DataTamer::LogChannel::create("channel");
+  auto sink = std::make_shared<CollectSink>();
+  channel->addDataSink(sink);
+
+  int32_t counter = 0;
+  std::array<double, 50> array = {};
+  std::vector<double> vect;
+  std::vector<Pose> poses(2);
+  uint8_t flag = 7;
+
+  channel->registerValue("counter", &counter);
+  channel->registerValue("array", &array);
+  channel->registerValue("vect", &vect);
+  channel->registerValue("poses", &poses);
+  auto flag_id = channel->registerValue("flag", &flag);
+
+  const int kCount = 6;
+  for(int i = 0; i < kCount; i++)
+  {
+    counter = i;
+    array[40] = i;
+    vect.resize(size_t(i), double(i));
+    poses[1].rot.z = i;
+    channel->setEnabled(flag_id, i % 2 == 0);
+    channel->takeSnapshot(std::chrono::nanoseconds(i));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  const auto schema = BuilSchemaFromText(ToStr(channel->getSchema()));
+  ParsePlan plan(schema);
+  // vect[3] doesn't exist yet
+  const std::vector<std::string> names = { "array[40]", "vect[3]", "poses[1]/rotation/z",
+                                           "flag", "unknown" };
+  plan.setProjection(names);
+  ASSERT_TRUE(plan.isSelected(*plan.findSeries("array[40]")));
+  ASSERT_FALSE(plan.isSelected(*plan.findSeries("counter")));
+
+  std::scoped_lock lk(sink->mutex);
+  ASSERT_EQ(sink->snapshots.size(), kCount);
+  for(int i = 0; i < kCount; i++)
+  {
+    const auto snapshot_view = ConvertSnapshot(sink->snapshots[size_t(i)]);
+    std::map<std::string, double> parsed_values;
+    ASSERT_TRUE(plan.parse(snapshot_view, [&](uint32_t series_id, auto value) {
+      parsed_values[plan.seriesName(series_id)] = double(value);
+    }));
+
+    std::map<std::string, double> expected;
+    expected["array[40]"] = i;
+    expected["poses[1]/rotation/z"] = i;
+    if(i > 3)
+    {
+      // resize() keeps the old values
+      expected["vect[3]"] = 4;
+    }
+    if(i % 2 == 0)
+    {
+      expected["flag"] = 7;
+    }
+    ASSERT_EQ(parsed_values, expected);
+  }
+
+  // projection by ID, after the elements of vect were found
+  plan.setProjection(std::vector<uint32_t>{ *plan.findSeries("vect[4]") });
+  size_t count = 0;
+  plan.parse(ConvertSnapshot(sink->snapshots.back()), [&](uint32_t series_id, auto value) {
+    ASSERT_EQ(plan.seriesName(series_id), "vect[4]");
+    ASSERT_EQ(value, 5);
+    count++;
+  });
+  ASSERT_EQ(count, 1);
+
+  plan.clearProjection();
+  count = 0;
+  plan.parse(ConvertSnapshot(sink->snapshots.back()), [&](uint32_t, auto) { count++; });
+  // counter, array, vect[0..4], poses (2 * 7), flag
+  ASSERT_EQ(count, 1 + 50 + 5 + 14);
+}
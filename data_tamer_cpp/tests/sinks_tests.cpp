@@ -0,0 +1,519 @@
+#include "data_tamer/data_tamer.hpp"
+#include "data_tamer/sinks/flight_recorder_sink.hpp"
+#include "data_tamer/sinks/mcap_sink.hpp"
+#include "data_tamer/sinks/shm_ring_sink.hpp"
+
+#include <mcap/reader.hpp>
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <thread>
+
+using namespace DataTamer;
+
+// timestamps of all the messages in a MCAP file
+std::vector<std::chrono::nanoseconds> ReadTimestamps(const std::string& filepath)
+{
+  std::vector<std::chrono::nanoseconds> timestamps;
+  mcap::McapReader reader;
+  if(!reader.open(filepath).ok())
+  {
+    return timestamps;
+  }
+  for(const auto& msg : reader.readMessages())
+  {
+    timestamps.emplace_back(msg.message.logTime);
+  }
+  reader.close();
+  return timestamps;
+}
+
+TEST(FlightRecorder, TriggerWindow)
+{
+  using std::chrono::milliseconds;
+
+  FlightRecorderOptions options;
+  options.pre_trigger = milliseconds(10);
+  options.post_trigger = milliseconds(5);
+
+  double value = 0;
+  {
+    auto channel = LogChannel::create("chan");
+    auto sink = std::make_shared<FlightRecorderSink>("flight_recorder_test", options);
+    channel->addDataSink(sink);
+    channel->registerValue("value", &value);
+
+    sink->setTriggerPredicate([](const Snapshot& snapshot) {
+      return snapshot.timestamp == milliseconds(50);
+    });
+
+    for(int i = 0; i < 100; i++)
+    {
+      value = i;
+      channel->takeSnapshot(milliseconds(i));
+    }
+    ASSERT_TRUE(sink->waitForDumps(std::chrono::seconds(5)));
+    ASSERT_EQ(sink->dumpedFiles().size(), 1);
+    ASSERT_EQ(sink->dumpedFiles().front(), "flight_recorder_test_1.mcap");
+    const auto timestamps = ReadTimestamps("flight_recorder_test_1.mcap");
+    ASSERT_EQ(timestamps.size(), 16);
+    ASSERT_EQ(timestamps.front(), milliseconds(40));
+    ASSERT_EQ(timestamps.back(), milliseconds(55));
+
+    // trigger manually. The post-trigger window is not complete, when the sink is
+    // destroyed.
+    std::this_thread::sleep_for(milliseconds(10));
+    ASSERT_TRUE(sink->trigger("flight_recorder_manual.mcap"));
+    ASSERT_FALSE(sink->trigger());
+    channel->takeSnapshot(milliseconds(100));
+    channel->takeSnapshot(milliseconds(101));
+    std::this_thread::sleep_for(milliseconds(10));
+  }
+  // the trigger time is the one of the first snapshot after the call (t=100)
+  const auto timestamps = ReadTimestamps("flight_recorder_manual.mcap");
+  ASSERT_EQ(timestamps.size(), 12);
+  ASSERT_EQ(timestamps.front(), milliseconds(90));
+  ASSERT_EQ(timestamps.back(), milliseconds(101));
+
+  std::remove("flight_recorder_test_1.mcap");
+  std::remove("flight_recorder_manual.mcap");
+}
+
+#ifndef _WIN32
+TEST(ShmRing, WrapAndConvert)
+{
+  using std::chrono::milliseconds;
+  const std::string ring_file = "shm_ring_test.dtring";
+  const std::string mcap_file = "shm_ring_test.mcap";
+
+  double value = 0;
+  {
+    auto channel = LogChannel::create("chan");
+    // each record is 40 bytes: the ring contains less than 26 of them
+    auto sink = std::make_shared<ShmRingSink>(ring_file, 1024);
+    channel->addDataSink(sink);
+    channel->registerValue("value", &value);
+
+    for(int i = 0; i < 100; i++)
+    {
+      value = i;
+      ASSERT_TRUE(channel->takeSnapshot(milliseconds(i)));
+    }
+    const auto stats = sink->getStatistics();
+    ASSERT_EQ(stats.enqueued, 100);
+    ASSERT_EQ(stats.stored, 100);
+    ASSERT_EQ(stats.dropped, 0);
+
+    // convert while the sink is still alive, as if the process crashed
+    const auto converted = ShmRingSink::convertToMCAP(ring_file, mcap_file);
+    ASSERT_GE(converted, 20);
+    ASSERT_LE(converted, 25);
+  }
+
+  const auto timestamps = ReadTimestamps(mcap_file);
+  ASSERT_GE(timestamps.size(), 20);
+  for(size_t i = 0; i < timestamps.size(); i++)
+  {
+    ASSERT_EQ(timestamps[i], milliseconds(100 - timestamps.size() + i));
+  }
+  {
+    mcap::McapReader reader;
+    ASSERT_TRUE(reader.open(mcap_file).ok());
+    uint32_t expected_sequence = 1;
+    for(const auto& msg : reader.readMessages())
+    {
+      ASSERT_EQ(msg.message.sequence, expected_sequence++);
+    }
+  }
+
+  ASSERT_ANY_THROW(ShmRingSink::convertToMCAP(mcap_file, "invalid.mcap"));
+
+  // a corrupted header must be rejected, not trusted
+  auto corruptHeader = [&](size_t offset, uint64_t value) {
+    std::fstream file(ring_file, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(std::streamoff(offset));
+    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  const size_t kDataCapacityOffset = 16;
+  const size_t kSchemasCapacityOffset = 8;
+  corruptHeader(kDataCapacityOffset, 0);
+  ASSERT_ANY_THROW(ShmRingSink::convertToMCAP(ring_file, mcap_file));
+  corruptHeader(kDataCapacityOffset, 1020);
+  ASSERT_ANY_THROW(ShmRingSink::convertToMCAP(ring_file, mcap_file));
+  // the sum of the capacities overflows
+  corruptHeader(kDataCapacityOffset, std::numeric_limits<uint64_t>::max() - 7);
+  ASSERT_ANY_THROW(ShmRingSink::convertToMCAP(ring_file, mcap_file));
+  corruptHeader(kDataCapacityOffset, 1024);
+  corruptHeader(kSchemasCapacityOffset, std::numeric_limits<uint64_t>::max());
+  ASSERT_ANY_THROW(ShmRingSink::convertToMCAP(ring_file, mcap_file));
+
+  std::remove(ring_file.c_str());
+  std::remove(mcap_file.c_str());
+}
+#endif
+
+TEST(MCAPSink, WriterOptions)
+{
+  const std::string filepath = "test_mcap_options.mcap";
+  const int kCount = 200;
+
+  std::vector<MCAPSinkOptions> options_sets(3);
+  // many small chunks, with CRC of the data section
+  options_sets[0].chunk_size = 1024;
+  options_sets[0].enable_data_crc = true;
+  // no chunks
+  options_sets[1].no_chunking = true;
+  // no index, no summary
+  options_sets[2].no_message_index = true;
+  options_sets[2].no_summary = true;
+  options_sets[2].no_chunk_crc = true;
+
+  for(const auto& options : options_sets)
+  {
+    {
+      auto sink = std::make_shared<MCAPSink>(filepath, options);
+      auto channel = LogChannel::create("chan");
+      channel->addDataSink(sink);
+      double value = 0;
+      channel->registerValue("value", &value);
+      for(int i = 0; i < kCount; i++)
+      {
+        value = i;
+        channel->takeSnapshot(std::chrono::nanoseconds(i));
+      }
+      ASSERT_EQ(sink->options().chunk_size, options.chunk_size);
+      const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+      while(sink->getStatistics().stored < kCount &&
+            std::chrono::steady_clock::now() < deadline)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+    ASSERT_EQ(ReadTimestamps(filepath).size(), size_t(kCount));
+  }
+  std::remove(filepath.c_str());
+
+  MCAPSinkOptions lz4;
+  lz4.compression = MCAPSinkOptions::Compression::LZ4;
+  if(!MCAPSink::isCompressionAvailable(lz4.compression))
+  {
+    ASSERT_THROW(MCAPSink(filepath, lz4), std::runtime_error);
+  }
+}
+
+TEST(MCAPSink, MessageLayout)
+{
+  const std::string filepath = "test_mcap_layout.mcap";
+  Snapshot snapshot;
+  snapshot.channel_name = "chan";
+  snapshot.schema_hash = 42;
+  snapshot.active_mask = { 0xFF, 0x01 };
+  snapshot.payload = { 1, 2, 3, 4, 5 };
+  {
+    MCAPSink sink(filepath);
+    Schema schema;
+    schema.channel_name = "chan";
+    schema.hash = 42;
+    sink.addChannel("chan", schema);
+    sink.storeSnapshot(snapshot);
+  }
+  // active mask and payload, each one preceded by its size
+  const std::vector<uint8_t> expected = { 2, 0, 0, 0, 0xFF, 0x01, 5, 0, 0, 0, 1, 2, 3, 4, 5 };
+
+  mcap::McapReader reader;
+  ASSERT_TRUE(reader.open(filepath).ok());
+  size_t count = 0;
+  for(const auto& msg : reader.readMessages())
+  {
+    const auto* data = reinterpret_cast<const uint8_t*>(msg.message.data);
+    ASSERT_EQ(std::vector<uint8_t>(data, data + msg.message.dataSize), expected);
+    count++;
+  }
+  reader.close();
+  ASSERT_EQ(count, 1);
+  std::remove(filepath.c_str());
+}
+
+TEST(MCAPSink, ChunkAge)
+{
+  const std::string filepath = "test_mcap_chunk_age.mcap";
+  const int kCount = 10;
+
+  MCAPSinkOptions options;
+  options.max_chunk_age = std::chrono::milliseconds(20);
+  options.sync_policy = MCAPSinkOptions::SyncPolicy::FLUSH;
+
+  auto sink = std::make_shared<MCAPSink>(filepath, options);
+  auto channel = LogChannel::create("chan");
+  channel->addDataSink(sink);
+  double value = 0;
+  channel->registerValue("value", &value);
+  for(int i = 0; i < kCount; i++)
+  {
+    channel->takeSnapshot(std::chrono::nanoseconds(i));
+  }
+  // the chunk is far from full, but it is closed by the sink thread, when idle
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+  // read while the file is still open, as after a crash
+  ASSERT_EQ(ReadTimestamps(filepath).size(), size_t(kCount));
+
+  sink.reset();
+  ASSERT_EQ(ReadTimestamps(filepath).size(), size_t(kCount));
+  std::remove(filepath.c_str());
+}
+
+TEST(MCAPSink, ParallelCompression)
+{
+  const std::string filepath = "test_mcap_parallel.mcap";
+  const int kCount = 2000;
+
+  MCAPSinkOptions options;
+  if(MCAPSink::isCompressionAvailable(MCAPSinkOptions::Compression::ZSTD))
+  {
+    options.compression = MCAPSinkOptions::Compression::ZSTD;
+  }
+  // many small chunks in flight at the same time
+  options.chunk_size = 1024;
+  options.compression_threads = 3;
+
+  uint64_t pushed = 0;
+  {
+    auto sink = std::make_shared<MCAPSink>(filepath, options);
+    auto channel = LogChannel::create("chan");
+    channel->addDataSink(sink);
+    int64_t value = 0;
+    channel->registerValue("value", &value);
+    for(int i = 0; i < kCount; i++)
+    {
+      value = i;
+      pushed += channel->takeSnapshot(std::chrono::nanoseconds(i)) ? 1 : 0;
+    }
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while(sink->getStatistics().stored < pushed && std::chrono::steady_clock::now() < deadline)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  ASSERT_GT(pushed, 0);
+  // chunks must be written in the same order they were filled
+  const auto timestamps = ReadTimestamps(filepath);
+  ASSERT_EQ(timestamps.size(), pushed);
+  for(size_t i = 1; i < timestamps.size(); i++)
+  {
+    ASSERT_LT(timestamps[i - 1], timestamps[i]);
+  }
+  std::remove(filepath.c_str());
+}
+
+TEST(MCAPSink, Rotation)
+{
+  namespace fs = std::filesystem;
+  const std::string filepath = "test_mcap_rotation.mcap";
+  const int kBatches = 40;
+  const int kBatchSize = 50;
+
+  auto list_files = [&]() {
+    std::vector<std::string> files;
+    for(const auto& entry : fs::directory_iterator(fs::current_path()))
+    {
+      const auto name = entry.path().filename().string();
+      if(name.rfind(filepath, 0) == 0)
+      {
+        files.push_back(name);
+      }
+    }
+    return files;
+  };
+  // leftovers of a previous run
+  for(const auto& file : list_files())
+  {
+    std::remove(file.c_str());
+  }
+
+  MCAPSinkOptions options;
+  options.chunk_size = 512;
+  int64_t last_timestamp = -1;
+  {
+    auto sink = std::make_shared<MCAPSink>(filepath, options);
+    sink->setMaxTimeBeforeReset(std::chrono::seconds(0));
+    sink->setMaxSizeBeforeReset(4 * 1024);
+    sink->setCreateNewFileOnReset(true);
+    sink->setRetention(2);
+
+    auto channel = LogChannel::create("chan");
+    channel->addDataSink(sink);
+    int64_t value = 0;
+    channel->registerValue("value", &value);
+    uint64_t pushed = 0;
+    for(int b = 0; b < kBatches; b++)
+    {
+      for(int i = 0; i < kBatchSize; i++)
+      {
+        value++;
+        if(channel->takeSnapshot(std::chrono::nanoseconds(value)))
+        {
+          pushed++;
+          last_timestamp = value;
+        }
+      }
+      while(sink->getStatistics().stored < pushed)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      // give time to the background thread to open the next file
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    sink->stopRecording();
+  }
+
+  const auto files = list_files();
+  // two old files, plus the last one. The first file was deleted
+  ASSERT_EQ(files.size(), 3);
+  ASSERT_FALSE(fs::exists(filepath));
+
+  int64_t max_timestamp = 0;
+  for(const auto& file : files)
+  {
+    ASSERT_EQ(file.find(".next"), std::string::npos);
+    const auto timestamps = ReadTimestamps(file);
+    ASSERT_FALSE(timestamps.empty());
+    max_timestamp = std::max(max_timestamp, int64_t(timestamps.back().count()));
+    std::remove(file.c_str());
+  }
+  ASSERT_EQ(max_timestamp, last_timestamp);
+}
+
+TEST(MCAPSink, RotationFailure)
+{
+  namespace fs = std::filesystem;
+  const std::string filepath = "test_mcap_rotation_failure.mcap";
+  // the next file can't be opened, because a directory has the same name
+  const std::string next_filepath = filepath + ".next";
+  std::error_code ec;
+  fs::remove_all(next_filepath, ec);
+  fs::create_directories(next_filepath + "/blocker");
+
+  MCAPSinkOptions options;
+  options.chunk_size = 512;
+  auto sink = std::make_shared<MCAPSink>(filepath, options);
+  sink->setMaxTimeBeforeReset(std::chrono::seconds(0));
+  sink->setMaxSizeBeforeReset(4 * 1024);
+
+  auto channel = LogChannel::create("chan");
+  channel->addDataSink(sink);
+  int64_t value = 0;
+  channel->registerValue("value", &value);
+  uint64_t pushed = 0;
+
+  auto push_batch = [&]() {
+    for(int i = 0; i < 50; i++)
+    {
+      value++;
+      if(channel->takeSnapshot(std::chrono::nanoseconds(value)))
+      {
+        pushed++;
+      }
+    }
+    while(sink->getStatistics().stored < pushed)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  };
+
+  // the failure is counted, and the next file requested again
+  for(int b = 0; b < 40 && sink->failedFileResets() < 2; b++)
+  {
+    push_batch();
+  }
+  ASSERT_GE(sink->failedFileResets(), 2);
+
+  // once the directory is removed, the reset succeeds
+  fs::remove_all(next_filepath);
+  const int64_t first_after_fix = value + 1;
+  for(int b = 0; b < 40; b++)
+  {
+    push_batch();
+  }
+  sink->stopRecording();
+
+  const auto timestamps = ReadTimestamps(filepath);
+  ASSERT_FALSE(timestamps.empty());
+  ASSERT_GT(timestamps.front().count(), first_after_fix);
+  ASSERT_EQ(timestamps.back().count(), value);
+  ASSERT_FALSE(fs::exists(next_filepath));
+  std::remove(filepath.c_str());
+}
+
+TEST(MCAPSink, Recovery)
+{
+  namespace fs = std::filesystem;
+  const std::string filepath = "test_mcap_recovery.mcap";
+  const std::string crashed = "test_mcap_recovery_crashed.mcap";
+  const std::string recovered = "test_mcap_recovery_fixed.mcap";
+
+  MCAPSinkOptions options;
+  options.chunk_size = 1024;
+  options.sync_policy = MCAPSinkOptions::SyncPolicy::FLUSH;
+
+  auto sink = std::make_shared<MCAPSink>(filepath, options);
+  auto channel = LogChannel::create("chan");
+  channel->addDataSink(sink);
+  int64_t value = 0;
+  channel->registerValue("value", &value);
+  uint64_t pushed = 0;
+  for(int i = 0; i < 2000; i++)
+  {
+    value = i;
+    pushed += channel->takeSnapshot(std::chrono::nanoseconds(i)) ? 1 : 0;
+  }
+  while(sink->getStatistics().stored < pushed)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // copy the file while it is still open, as after a crash, and cut the last record
+  fs::copy_file(filepath, crashed, fs::copy_options::overwrite_existing);
+  fs::resize_file(crashed, fs::file_size(crashed) - 100);
+
+  auto check_file = [](const std::string& file, const MCAPRecoveryStats& stats) {
+    mcap::McapReader reader;
+    ASSERT_TRUE(reader.open(file).ok());
+    ASSERT_TRUE(reader.readSummary(mcap::ReadSummaryMethod::NoFallbackScan).ok());
+    ASSERT_EQ(reader.statistics()->messageCount, stats.messages);
+    reader.close();
+
+    const auto timestamps = ReadTimestamps(file);
+    ASSERT_EQ(timestamps.size(), stats.messages);
+    for(size_t i = 1; i < timestamps.size(); i++)
+    {
+      ASSERT_LT(timestamps[i - 1], timestamps[i]);
+    }
+  };
+
+  const auto stats = MCAPSink::recoverFile(crashed, recovered, 2);
+  ASSERT_GT(stats.chunks, 0);
+  ASSERT_GT(stats.messages, 0);
+  ASSERT_GT(stats.discarded_bytes, 0);
+  check_file(recovered, stats);
+
+  // in place
+  const auto stats_in_place = MCAPSink::recoverFile(crashed);
+  ASSERT_EQ(stats_in_place.messages, stats.messages);
+  ASSERT_EQ(fs::file_size(crashed), fs::file_size(recovered));
+  check_file(crashed, stats_in_place);
+
+  // a file that was already repaired is unchanged
+  ASSERT_EQ(MCAPSink::recoverFile(crashed).messages, stats.messages);
+  check_file(crashed, stats);
+
+  sink.reset();
+  std::remove(filepath.c_str());
+  std::remove(crashed.c_str());
+  std::remove(recovered.c_str());
+}
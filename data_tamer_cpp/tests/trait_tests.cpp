@@ -106,3 +106,118 @@ TEST(CustomTypeTrait, BufferSize)
   // this wouldn't compile since it isn't in a container and has no type def
   // BufferSize(no_type_def);
 }
+
+// a matrix with contiguous storage, similar to Eigen::Matrix, that opts-in the
+// bulk serialization
+struct Matrix3f
+{
+  std::array<float, 9> values;
+  const float* data() const { return values.data(); }
+  float* data() { return values.data(); }
+  size_t size() const { return values.size(); }
+};
+
+// a dynamic buffer, that can be resized during deserialization
+struct DynamicBuffer
+{
+  std::vector<int32_t> values;
+  const int32_t* data() const { return values.data(); }
+  int32_t* data() { return values.data(); }
+  size_t size() const { return values.size(); }
+  void resize(size_t n) { values.resize(n); }
+};
+
+template <>
+struct SerializeMe::is_contiguous_container<Matrix3f> : std::true_type
+{
+};
+
+template <>
+struct SerializeMe::is_contiguous_container<DynamicBuffer> : std::true_type
+{
+};
+
+static_assert(is_contiguous_container<std::vector<double>>::value);
+static_assert(is_contiguous_container<std::array<int, 3>>::value);
+static_assert(!is_contiguous_container<std::vector<bool>>::value);
+static_assert(!is_contiguous_container<CustomNoTypeDef>::value);
+
+template <typename T>
+T SerializeAndBack(const T& value, size_t expected_size)
+{
+  std::vector<uint8_t> buffer(BufferSize(value));
+  EXPECT_EQ(buffer.size(), expected_size);
+  SpanBytes write_span(buffer);
+  SerializeIntoBuffer(write_span, value);
+  EXPECT_EQ(write_span.size(), 0);
+
+  T out{};
+  SpanBytesConst read_span(buffer.data(), buffer.size());
+  DeserializeFromBuffer(read_span, out);
+  EXPECT_EQ(read_span.size(), 0);
+  return out;
+}
+
+TEST(ContiguousContainers, RoundTrip)
+{
+  enum class Mode : int16_t
+  {
+    A = 1,
+    B = 2
+  };
+
+  std::vector<double> doubles(500);
+  for(size_t i = 0; i < doubles.size(); i++)
+  {
+    doubles[i] = 0.5 * double(i);
+  }
+  EXPECT_EQ(SerializeAndBack(doubles, 4 + 500 * 8), doubles);
+
+  const std::array<uint8_t, 5> bytes = { 1, 2, 3, 4, 5 };
+  EXPECT_EQ(SerializeAndBack(bytes, 5), bytes);
+
+  const std::array<int16_t, 3> shorts = { -1, 2, -3 };
+  EXPECT_EQ(SerializeAndBack(shorts, 6), shorts);
+
+  const std::vector<Mode> modes = { Mode::A, Mode::B, Mode::A };
+  EXPECT_EQ(SerializeAndBack(modes, 4 + 3 * 2), modes);
+
+  const std::vector<bool> flags = { true, false, true };
+  EXPECT_EQ(SerializeAndBack(flags, 4 + 3), flags);
+
+  const Matrix3f matrix = { { 1, 2, 3, 4, 5, 6, 7, 8, 9 } };
+  EXPECT_EQ(SerializeAndBack(matrix, 4 + 9 * 4).values, matrix.values);
+
+  const DynamicBuffer dynamic = { { 10, 20, 30, 40 } };
+  EXPECT_EQ(SerializeAndBack(dynamic, 4 + 4 * 4).values, dynamic.values);
+}
+
+TEST(ContiguousContainers, Span)
+{
+  const std::vector<double> values = { 1, 2, 3 };
+  const Span<const double> span(values.data(), values.size());
+
+  std::vector<uint8_t> buffer(BufferSize(span));
+  ASSERT_EQ(buffer.size(), 4 + 3 * 8);
+  SpanBytes write_span(buffer);
+  SerializeIntoBuffer(write_span, span);
+
+  // a span is serialized exactly like a vector
+  std::vector<double> out;
+  SpanBytesConst read_span(buffer.data(), buffer.size());
+  DeserializeFromBuffer(read_span, out);
+  ASSERT_EQ(out, values);
+}
+
+TEST(ContiguousContainers, Overflow)
+{
+  std::vector<double> values(10);
+  std::vector<uint8_t> buffer(BufferSize(values) - 1);
+  SpanBytes write_span(buffer);
+  ASSERT_ANY_THROW(SerializeIntoBuffer(write_span, values));
+
+  // a corrupted size prefix must not cause a large allocation
+  std::array<uint8_t, 8> corrupted = { 0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0 };
+  SpanBytesConst read_span(corrupted.data(), corrupted.size());
+  ASSERT_ANY_THROW(DeserializeFromBuffer(read_span, values));
+}
@@ -0,0 +1,29 @@
+#include "data_tamer/sinks/mcap_sink.hpp"
+
+#include <iostream>
+
+// Repair a MCAP file that was not closed, because the process that was recording
+// crashed: the truncated data at the end is removed and the index is rebuilt.
+int main(int argc, char** argv)
+{
+  if(argc != 2 && argc != 3)
+  {
+    std::cout << "usage: dt_mcap_recover <input.mcap> [output.mcap]\n"
+                 "If the output is not specified, the input file is repaired in place."
+              << std::endl;
+    return 1;
+  }
+  try
+  {
+    const std::string output = (argc == 3) ? argv[2] : "";
+    const auto stats = DataTamer::MCAPSink::recoverFile(argv[1], output);
+    std::cout << "recovered " << stats.messages << " messages in " << stats.chunks
+              << " chunks, discarded " << stats.discarded_bytes << " bytes" << std::endl;
+  }
+  catch(std::exception& err)
+  {
+    std::cerr << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
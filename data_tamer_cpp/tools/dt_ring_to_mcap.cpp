@@ -0,0 +1,25 @@
+#include "data_tamer/sinks/shm_ring_sink.hpp"
+
+#include <iostream>
+
+// Convert the ring buffer file created by ShmRingSink into a MCAP file.
+// It can be used after the process that was recording crashed.
+int main(int argc, char** argv)
+{
+  if(argc != 3)
+  {
+    std::cout << "usage: dt_ring_to_mcap <ring file> <output.mcap>" << std::endl;
+    return 1;
+  }
+  try
+  {
+    const size_t count = DataTamer::ShmRingSink::convertToMCAP(argv[1], argv[2]);
+    std::cout << "saved " << count << " snapshots into " << argv[2] << std::endl;
+  }
+  catch(std::exception& err)
+  {
+    std::cerr << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}